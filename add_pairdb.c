@@ -0,0 +1,56 @@
+/* file: add_pairdb.c
+ * description: Copies a forward fastQ entry into the forward fastQ database
+ * author: Daniel Garrigan Lummei Analytics LLC
+ * updated: November 2016
+ * email: dgarriga@lummei.net
+ * copyright: MIT license
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "khash.h"
+#include "ddradseq.h"
+
+int add_pairdb(PAIRDB *db, const FQREC *rec, const char *key, size_t klen)
+{
+	char *t = NULL;
+	char *mkey = NULL;
+	int a = 0;
+	khint_t k = 0;
+	FASTQ *e = NULL;
+
+	/* Copy the entry and its key out of the reader's buffer into the arena */
+	e = arena_alloc(db->arena, sizeof(FASTQ) + rec->idlen + rec->seqlen +
+	                rec->quallen + klen + 4u);
+	if (!e)
+		return 1;
+	e->idlen = rec->idlen;
+	e->seqlen = rec->seqlen;
+	e->quallen = rec->quallen;
+	t = e->text;
+	memcpy(t, rec->id, rec->idlen);
+	t += rec->idlen;
+	*t++ = '\0';
+	memcpy(t, rec->seq, rec->seqlen);
+	t += rec->seqlen;
+	*t++ = '\0';
+	memcpy(t, rec->qual, rec->quallen);
+	t += rec->quallen;
+	*t++ = '\0';
+	mkey = t;
+	memcpy(mkey, key, klen);
+	mkey[klen] = '\0';
+
+	/* Add to database; a repeated key replaces the earlier entry, */
+	/* which stays in the arena until the arena is released */
+	k = kh_put(fastq, db->h, mkey, &a);
+	if (UNLIKELY(a < 0))
+	{
+		logerror(db->arena->lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
+		return 1;
+	}
+	kh_value(db->h, k) = e;
+
+	return 0;
+}
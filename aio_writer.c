@@ -0,0 +1,381 @@
+/* file: aio_writer.c
+ * description: Asynchronous output writes through a Linux io_uring
+ * author: Daniel Garrigan Lummei Analytics LLC
+ * updated: November 2016
+ * email: dgarriga@lummei.net
+ * copyright: MIT license
+ * note: Talks to the kernel through the raw io_uring system calls so that
+ *       only the kernel headers are needed (Linux 5.1 or newer)
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <linux/io_uring.h>
+#include "ddradseq.h"
+
+extern int errno;
+
+/* State of the write ring */
+static struct aio_ring_t
+{
+	int fd;                        /* File descriptor of the ring */
+	bool fixed;                    /* Flag whether the buffers are registered */
+	unsigned int depth;            /* Maximum number of writes in flight */
+	unsigned int inflight;         /* Number of writes currently in flight */
+	unsigned int nfree;            /* Number of buffers on the free list */
+	unsigned int *freelist;        /* Stack of free buffer slots */
+	unsigned int *sq_head;
+	unsigned int *sq_tail;
+	unsigned int *sq_mask;
+	unsigned int *sq_array;
+	unsigned int *cq_head;
+	unsigned int *cq_tail;
+	unsigned int *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	void *sq_ptr;
+	void *cq_ptr;
+	size_t sq_size;
+	size_t cq_size;
+	size_t sqe_size;
+	size_t buflen;                 /* Capacity of each write buffer */
+	char *bufmem;                  /* Memory backing all write buffers */
+	struct iovec *iov;             /* One vector per buffer slot */
+	int *slot_fd;                  /* Target file of the write in each slot */
+	off_t *slot_off;               /* Target offset of the write in each slot */
+	int errors;                    /* Number of failed writes since last drain */
+	FILE *lf;
+} ring = { .fd = -1 };
+
+/* Serializes access to the ring from concurrent writer threads */
+static pthread_mutex_t ring_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Signalled whenever a buffer is submitted or released, or a submission fails */
+static pthread_cond_t ring_cond = PTHREAD_COND_INITIALIZER;
+
+/* Function prototypes */
+static int reap(unsigned int min_complete);
+
+int aio_init(unsigned int depth, FILE *lf)
+{
+	unsigned int i = 0;
+	struct io_uring_params p;
+	struct rlimit rl;
+
+	ring.lf = lf;
+	memset(&p, 0, sizeof(p));
+	ring.fd = syscall(__NR_io_uring_setup, depth, &p);
+	if (ring.fd < 0)
+	{
+		logwarn(lf, "Asynchronous writes are not available (%s); using synchronous writes.\n",
+		        strerror(errno));
+		return 1;
+	}
+
+	/* Map the submission and completion rings */
+	ring.sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	ring.cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		if (ring.cq_size > ring.sq_size)
+			ring.sq_size = ring.cq_size;
+		ring.cq_size = ring.sq_size;
+	}
+	ring.sq_ptr = mmap(NULL, ring.sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+	                   ring.fd, IORING_OFF_SQ_RING);
+	if (ring.sq_ptr == MAP_FAILED)
+		goto fail;
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		ring.cq_ptr = ring.sq_ptr;
+	else
+	{
+		ring.cq_ptr = mmap(NULL, ring.cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		                   ring.fd, IORING_OFF_CQ_RING);
+		if (ring.cq_ptr == MAP_FAILED)
+			goto fail;
+	}
+	ring.sqe_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	ring.sqes = mmap(NULL, ring.sqe_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+	                 ring.fd, IORING_OFF_SQES);
+	if (ring.sqes == MAP_FAILED)
+		goto fail;
+	ring.sq_head = (unsigned int*)((char*)ring.sq_ptr + p.sq_off.head);
+	ring.sq_tail = (unsigned int*)((char*)ring.sq_ptr + p.sq_off.tail);
+	ring.sq_mask = (unsigned int*)((char*)ring.sq_ptr + p.sq_off.ring_mask);
+	ring.sq_array = (unsigned int*)((char*)ring.sq_ptr + p.sq_off.array);
+	ring.cq_head = (unsigned int*)((char*)ring.cq_ptr + p.cq_off.head);
+	ring.cq_tail = (unsigned int*)((char*)ring.cq_ptr + p.cq_off.tail);
+	ring.cq_mask = (unsigned int*)((char*)ring.cq_ptr + p.cq_off.ring_mask);
+	ring.cqes = (struct io_uring_cqe*)((char*)ring.cq_ptr + p.cq_off.cqes);
+
+	/* Allocate one write buffer per slot, large enough for a */
+	/* compressed block of BUFLEN bytes in either output format */
+	ring.depth = depth < p.sq_entries ? depth : p.sq_entries;
+	ring.buflen = compress_bound(BUFLEN, GZIP_FORMAT);
+	if (compress_bound(BUFLEN, ZSTD_FORMAT) > ring.buflen)
+		ring.buflen = compress_bound(BUFLEN, ZSTD_FORMAT);
+	ring.buflen = (ring.buflen + 4095u) & ~(size_t)4095u;
+	ring.bufmem = mmap(NULL, ring.depth * ring.buflen, PROT_READ | PROT_WRITE,
+	                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	ring.iov = malloc(ring.depth * sizeof(struct iovec));
+	ring.freelist = malloc(ring.depth * sizeof(unsigned int));
+	ring.slot_fd = malloc(ring.depth * sizeof(int));
+	ring.slot_off = malloc(ring.depth * sizeof(off_t));
+	if (ring.bufmem == MAP_FAILED || !ring.iov || !ring.freelist || !ring.slot_fd || !ring.slot_off)
+	{
+		logerror(lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
+		goto fail;
+	}
+	for (i = 0; i < ring.depth; i++)
+	{
+		ring.iov[i].iov_base = ring.bufmem + i * ring.buflen;
+		ring.iov[i].iov_len = ring.buflen;
+		ring.freelist[i] = ring.depth - 1u - i;
+	}
+	ring.nfree = ring.depth;
+	ring.inflight = 0;
+	ring.errors = 0;
+
+	/* Registered buffers are pinned once instead of on every write */
+	/* Older kernels charge them to RLIMIT_MEMLOCK, so fall back to */
+	/* ordinary vectored writes if the registration is refused */
+	ring.fixed = syscall(__NR_io_uring_register, ring.fd, IORING_REGISTER_BUFFERS,
+	                     ring.iov, ring.depth) == 0;
+
+	/* Output files stay open while their writes are in flight */
+	if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max)
+	{
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rl);
+	}
+
+	loginfo(lf, "using asynchronous writes with %u writes in flight%s.\n", ring.depth,
+	        ring.fixed ? " and registered buffers" : "");
+	return 0;
+
+fail:
+	logwarn(lf, "Failed to set up asynchronous writes; using synchronous writes.\n");
+	aio_destroy();
+	return 1;
+}
+
+bool aio_enabled(void)
+{
+	return ring.fd >= 0;
+}
+
+size_t aio_buflen(void)
+{
+	return ring.buflen;
+}
+
+char *aio_buffer(void)
+{
+	char *buf = NULL;
+
+	/* Only stall for a completion when all buffers are in flight, or */
+	/* for a submission when other threads hold the rest; the buffer */
+	/* belongs to the caller until it is submitted */
+	pthread_mutex_lock(&ring_lock);
+	while (ring.nfree == 0 && ring.errors == 0)
+	{
+		if (ring.inflight == 0)
+			pthread_cond_wait(&ring_cond, &ring_lock);
+		else if (reap(1) < 0)
+			break;
+	}
+	if (ring.nfree > 0)
+		buf = ring.iov[ring.freelist[--ring.nfree]].iov_base;
+	pthread_mutex_unlock(&ring_lock);
+	return buf;
+}
+
+void aio_release(char *buf)
+{
+	unsigned int slot = (unsigned int)((buf - ring.bufmem) / ring.buflen);
+
+	/* A buffer that was never submitted goes straight back on the free list */
+	pthread_mutex_lock(&ring_lock);
+	ring.freelist[ring.nfree++] = slot;
+	pthread_cond_broadcast(&ring_cond);
+	pthread_mutex_unlock(&ring_lock);
+}
+
+int aio_submit(int fd, char *buf, size_t len, off_t offset)
+{
+	unsigned int slot = (unsigned int)((buf - ring.bufmem) / ring.buflen);
+	unsigned int tail = 0;
+	unsigned int idx = 0;
+	struct io_uring_sqe *sqe = NULL;
+	int ret = 0;
+
+	pthread_mutex_lock(&ring_lock);
+	tail = *ring.sq_tail;
+	idx = tail & *ring.sq_mask;
+	sqe = &ring.sqes[idx];
+	ring.slot_fd[slot] = fd;
+	ring.slot_off[slot] = offset;
+	ring.iov[slot].iov_len = len;
+
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	sqe->fd = fd;
+	sqe->off = offset;
+	sqe->user_data = slot;
+	if (ring.fixed)
+	{
+		sqe->opcode = IORING_OP_WRITE_FIXED;
+		sqe->addr = (unsigned long)buf;
+		sqe->len = len;
+		sqe->buf_index = slot;
+	}
+	else
+	{
+		sqe->opcode = IORING_OP_WRITEV;
+		sqe->addr = (unsigned long)&ring.iov[slot];
+		sqe->len = 1;
+	}
+	ring.sq_array[idx] = idx;
+	__atomic_store_n(ring.sq_tail, tail + 1u, __ATOMIC_RELEASE);
+
+	do
+		ret = syscall(__NR_io_uring_enter, ring.fd, 1, 0, 0, NULL, 0);
+	while (ret < 0 && errno == EINTR);
+	if (ret < 0)
+	{
+		logerror(ring.lf, "%s:%d Failed to submit asynchronous write: %s.\n", __func__,
+		         __LINE__, strerror(errno));
+
+		/* Take back the entry, unless the kernel has consumed it, */
+		/* and the buffer with it */
+		if (__atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE) == tail)
+		{
+			__atomic_store_n(ring.sq_tail, tail, __ATOMIC_RELEASE);
+			ring.iov[slot].iov_len = ring.buflen;
+			ring.freelist[ring.nfree++] = slot;
+		}
+		ring.errors++;
+		pthread_cond_broadcast(&ring_cond);
+		pthread_mutex_unlock(&ring_lock);
+		return 1;
+	}
+	ring.inflight++;
+	pthread_cond_broadcast(&ring_cond);
+
+	/* Recycle the buffers of any writes that have already finished */
+	ret = reap(0) < 0;
+	pthread_mutex_unlock(&ring_lock);
+	return ret;
+}
+
+int aio_drain(void)
+{
+	int ret = 0;
+
+	/* Writes of other threads are waited for as well, and a failed */
+	/* write fails every later drain, since it ends the run anyway */
+	pthread_mutex_lock(&ring_lock);
+	while (ring.inflight > 0 && ret == 0)
+		if (reap(1) < 0)
+			ret = 1;
+	if (ring.errors > 0)
+		ret = 1;
+	pthread_mutex_unlock(&ring_lock);
+	return ret;
+}
+
+void aio_destroy(void)
+{
+	if (ring.fd >= 0)
+	{
+		aio_drain();
+		close(ring.fd);
+	}
+	if (ring.sqes && ring.sqes != MAP_FAILED)
+		munmap(ring.sqes, ring.sqe_size);
+	if (ring.cq_ptr && ring.cq_ptr != MAP_FAILED && ring.cq_ptr != ring.sq_ptr)
+		munmap(ring.cq_ptr, ring.cq_size);
+	if (ring.sq_ptr && ring.sq_ptr != MAP_FAILED)
+		munmap(ring.sq_ptr, ring.sq_size);
+	if (ring.bufmem && ring.bufmem != MAP_FAILED)
+		munmap(ring.bufmem, ring.depth * ring.buflen);
+	free(ring.iov);
+	free(ring.freelist);
+	free(ring.slot_fd);
+	free(ring.slot_off);
+	memset(&ring, 0, sizeof(ring));
+	ring.fd = -1;
+}
+
+static int reap(unsigned int min_complete)
+{
+	unsigned int head = 0;
+	int ret = 0;
+
+	if (min_complete > 0)
+	{
+		do
+			ret = syscall(__NR_io_uring_enter, ring.fd, 0, min_complete,
+			              IORING_ENTER_GETEVENTS, NULL, 0);
+		while (ret < 0 && errno == EINTR);
+		if (ret < 0)
+		{
+			logerror(ring.lf, "%s:%d Failed to wait for asynchronous writes: %s.\n",
+			         __func__, __LINE__, strerror(errno));
+			return -1;
+		}
+	}
+
+	head = *ring.cq_head;
+	while (head != __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE))
+	{
+		struct io_uring_cqe *cqe = &ring.cqes[head & *ring.cq_mask];
+		unsigned int slot = (unsigned int)cqe->user_data;
+		char *buf = ring.iov[slot].iov_base;
+		size_t len = ring.iov[slot].iov_len;
+		ssize_t done = cqe->res;
+
+		if (done < 0)
+		{
+			logerror(ring.lf, "%s:%d Asynchronous write failed: %s.\n", __func__,
+			         __LINE__, strerror(-cqe->res));
+			ring.errors++;
+		}
+		else
+		{
+			/* Finish a short write synchronously */
+			while ((size_t)done < len)
+			{
+				ssize_t nw = pwrite(ring.slot_fd[slot], buf + done, len - done,
+				                    ring.slot_off[slot] + done);
+				if (nw <= 0)
+				{
+					logerror(ring.lf, "%s:%d Asynchronous write failed: %s.\n",
+					         __func__, __LINE__, strerror(errno));
+					ring.errors++;
+					break;
+				}
+				done += nw;
+			}
+		}
+
+		/* Put the buffer back on the free list */
+		ring.iov[slot].iov_len = ring.buflen;
+		ring.freelist[ring.nfree++] = slot;
+		ring.inflight--;
+		head++;
+	}
+	__atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+
+	return 0;
+}
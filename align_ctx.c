@@ -0,0 +1,142 @@
+/* file: align_ctx.c
+ * description: Reusable buffers for the local alignment of one thread
+ * author: Daniel Garrigan Lummei Analytics LLC
+ * updated: November 2016
+ * email: dgarriga@lummei.net
+ * copyright: MIT license
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "ddradseq.h"
+
+/* Define alphabet size */
+#define ALPHA_SIZE 5
+
+/* Alignment of the profile vectors, for the widest kernel */
+#define VALIGN 64
+
+ALIGN_CTX *align_ctx_create(FILE *lf)
+{
+	ALIGN_CTX *ctx = NULL;
+
+	ctx = calloc(1, sizeof(ALIGN_CTX));
+	if (UNLIKELY(!ctx))
+	{
+		logerror(lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
+		return NULL;
+	}
+
+	/* The cache is fixed in size, so it is bounded however many pairs pass */
+	ctx->memo = calloc(MEMO_SLOTS, sizeof(ALIGN_MEMO));
+	if (UNLIKELY(!ctx->memo))
+	{
+		logerror(lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
+		free(ctx);
+		return NULL;
+	}
+	ctx->kern = align_kernel();
+	ctx->lf = lf;
+	return ctx;
+}
+
+int align_ctx_reserve(ALIGN_CTX *ctx, int qlen, int tlen)
+{
+	int len = 0;
+	size_t size = 0;
+	void *tmp = NULL;
+
+	/* The profile is sized for 16-bit cells in the widest vectors, */
+	/* which fits every kernel; the sequences share one length so */
+	/* either may take either buffer */
+	len = qlen > tlen ? qlen : tlen;
+	if (qlen > ctx->qcap || !ctx->q)
+	{
+		size = sizeof(ALIGN_QUERY) + VALIGN + (ALPHA_SIZE + 4) * (2 * (size_t)qlen + VALIGN);
+		tmp = realloc(ctx->q, size);
+		if (UNLIKELY(!tmp))
+		{
+			logerror(ctx->lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
+			return 1;
+		}
+		ctx->q = tmp;
+		ctx->qcap = qlen;
+	}
+	if (len > ctx->tcap || !ctx->b)
+	{
+		tmp = realloc(ctx->b, (len + 1u) * sizeof(uint64_t));
+		if (tmp)
+			ctx->b = tmp;
+		tmp = tmp ? realloc(ctx->query, len + 1u) : NULL;
+		if (tmp)
+			ctx->query = tmp;
+		tmp = tmp ? realloc(ctx->target, len + 1u) : NULL;
+		if (UNLIKELY(!tmp))
+		{
+			logerror(ctx->lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
+			return 1;
+		}
+		ctx->target = tmp;
+		ctx->tcap = len;
+	}
+	return 0;
+}
+
+int align_ctx_reserve_batch(ALIGN_CTX *ctx, int len)
+{
+	size_t vlen = 0;
+	void *tmp = NULL;
+
+	/* Queries, targets and the two score rows each take one vector of */
+	/* the widest width per position, so every kernel fits */
+	if (len > ctx->bcap || !ctx->bmem)
+	{
+		vlen = (size_t)len * VALIGN;
+		tmp = realloc(ctx->bmem, 4 * vlen + VALIGN);
+		if (UNLIKELY(!tmp))
+		{
+			logerror(ctx->lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
+			return 1;
+		}
+		ctx->bmem = tmp;
+		ctx->bq = (unsigned char*)(((size_t)tmp + VALIGN - 1) / VALIGN * VALIGN);
+		ctx->bt = ctx->bq + vlen;
+		ctx->bwork = ctx->bt + vlen;
+		ctx->bcap = len;
+	}
+	return 0;
+}
+
+int align_ctx_reserve_band(ALIGN_CTX *ctx, int band)
+{
+	void *tmp = NULL;
+
+	/* Two rows each of scores and of vertical gap scores */
+	if (band > ctx->bandcap || !ctx->band)
+	{
+		tmp = realloc(ctx->band, 4 * (2 * (size_t)band + 1) * sizeof(int));
+		if (UNLIKELY(!tmp))
+		{
+			logerror(ctx->lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
+			return 1;
+		}
+		ctx->band = tmp;
+		ctx->bandcap = band;
+	}
+	return 0;
+}
+
+void align_ctx_destroy(ALIGN_CTX *ctx)
+{
+	if (!ctx)
+		return;
+	free(ctx->q);
+	free(ctx->b);
+	free(ctx->query);
+	free(ctx->target);
+	free(ctx->bmem);
+	free(ctx->band);
+	free(ctx->memo);
+	free(ctx);
+}
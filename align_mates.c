@@ -1,5 +1,5 @@
 /* file align_mates.c
- * description: Align mates in two fastQ files and trim 3' end of reverse sequences
+ * description: Align the mates of each pair and trim 3' end of the reverse sequence
  * author: Daniel Garrigan Lummei Analytics LLC
  * updated: November 2016
  * email: dgarriga@lummei.net
@@ -9,12 +9,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <errno.h>
-#include <zlib.h>
 #include "ddradseq.h"
 
-#define NBASES 4
-
 /*Globally scoped variables */
 const char seq_nt4_table[256] = {
   4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
@@ -35,209 +31,360 @@ const char seq_nt4_table[256] = {
   4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4
 };
 const char alpha[5] = "ACGTN";
-extern int errno;
 
-int align_mates(const CMD *cp, const char *forin, const char *revin, const char *forout, const char *revout)
+/* Seeds shorter than this are found in most unrelated pairs */
+#define SEED_MIN 8
+
+/* Seeds are packed two bits per base into one 64-bit word */
+#define SEED_MAX 32
+
+/* Function prototypes */
+static bool may_overlap(const CMD *cp, const char *mat, ALIGN_CTX *ctx, const char *query,
+                        int qlen, const char *target, int tlen);
+static int seed_length(const CMD *cp, const char *mat, int len);
+static void score_batch(const CMD *cp, const char *mat, ALIGN_CTX *ctx, const FQREC *frec,
+                        FQREC *rrec, const size_t *idx, uint64_t (*key)[2], int m, int qmax,
+                        int tmax, unsigned int *count);
+static void align_pair(const CMD *cp, const char *mat, ALIGN_CTX *ctx, const FQREC *frec,
+                       FQREC *rrec, const uint64_t *key, unsigned int *count);
+static void pair_key(const FQREC *frec, const FQREC *rrec, uint64_t *key);
+static void hash_bytes(const char *s, size_t len, uint64_t *h1, uint64_t *h2);
+static void memo_store(ALIGN_CTX *ctx, const uint64_t *key, int score, int query_begin,
+                       int target_begin);
+static void trim_mate(const CMD *cp, FQREC *rrec, int score, int query_begin, int target_begin,
+                      unsigned int *count);
+
+int align_mates(const CMD *cp, const char *mat, ALIGN_CTX *ctx, const FQREC *frec, FQREC *rrec,
+                size_t n, unsigned int *count)
 {
-	char **fbuf = NULL;
-	char **rbuf = NULL;
-	char *errstr = NULL;
-	char mat[25];
-	int i = 0;
+	char *query = NULL;
+	char *target = NULL;
+	unsigned char *bq = NULL;
+	unsigned char *bt = NULL;
 	int j = 0;
-	int k = 0;
-	int xtra = KSW_XSTART;
-	const int sa = 1;
-	const int sb = 3;
-	const int gap_open = cp->gapo;
-	const int gap_extend = cp->gape;
-	const int min_score = cp->score;
-	unsigned int count = 0;
-	size_t l = 0;
-	size_t lc = 0;
+	int m = 0;
+	int qlen = 0;
+	int tlen = 0;
+	int qmax = 0;
+	int tmax = 0;
+	int gq = 0;
+	int gt = 0;
+	const int lanes = ctx->kern->lanes;
+	size_t i = 0;
+	size_t idx[64];
+	uint64_t key[64][2];
+	const ALIGN_MEMO *e = NULL;
 	FILE *lf = cp->lf;
-	gzFile fin;
-	gzFile rin;
-	gzFile fout;
-	gzFile rout;
-
-	/* Allocate buffer memory from the heap */
-	fbuf = malloc(BSIZE * sizeof(char*));
-	if (UNLIKELY(fbuf == NULL))
+
+	/* The buffers are reserved once for the longest sequences of the run */
+	for (i = 0; i < n; i++)
 	{
-		logerror(lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
-		return 1;
+		if ((int)rrec[i].seqlen > qmax)
+			qmax = (int)rrec[i].seqlen;
+		if ((int)frec[i].seqlen > tmax)
+			tmax = (int)frec[i].seqlen;
 	}
-	rbuf = malloc(BSIZE * sizeof(char*));
-	if (UNLIKELY(rbuf == NULL))
-	{
-		logerror(lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
+	if (align_ctx_reserve(ctx, qmax, tmax))
 		return 1;
-	}
-	for (i = 0; i < BSIZE; i++)
+	if (align_ctx_reserve_batch(ctx, qmax > tmax ? qmax : tmax))
+		return 1;
+	if (cp->band && align_ctx_reserve_band(ctx, cp->band))
+		return 1;
+
+	/* Empty lanes and the ends of the shorter sequences are padded */
+	/* with N, which scores zero */
+	bq = ctx->bq;
+	bt = ctx->bt;
+	memset(bq, 4, (size_t)qmax * lanes);
+	memset(bt, 4, (size_t)tmax * lanes);
+	query = ctx->query;
+	target = ctx->target;
+
+	/* Pairs that cannot overlap are dropped first; the rest are scored */
+	/* a vector of lanes at a time, one pair per lane, and only those */
+	/* that reach the minimum score are aligned in full */
+	for (i = 0; i < n; i++)
 	{
-		fbuf[i] = malloc(MAX_LINE_LENGTH);
-		if (UNLIKELY(!fbuf[i]))
+		/* A pair seen lately is trimmed as it was then, without */
+		/* being encoded or aligned again */
+		pair_key(&frec[i], &rrec[i], key[m]);
+		e = &ctx->memo[key[m][1] & (MEMO_SLOTS - 1)];
+		ctx->memo_pairs++;
+		if (e->key[0] == key[m][0] && e->key[1] == key[m][1])
 		{
-			logerror(lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
+			ctx->memo_hits++;
+			trim_mate(cp, &rrec[i], e->score, e->query_begin, e->target_begin, count);
+			continue;
+		}
+
+		qlen = (int)rrec[i].seqlen;
+		tlen = (int)frec[i].seqlen;
+		if (revcom_nt4(rrec[i].seq, rrec[i].seqlen, query, lf))
 			return 1;
+		encode_nt4(frec[i].seq, frec[i].seqlen, target);
+		if (!may_overlap(cp, mat, ctx, query, qlen, target, tlen))
+		{
+			memo_store(ctx, key[m], 0, -1, -1);
+			continue;
 		}
-		rbuf[i] = malloc(MAX_LINE_LENGTH);
-		if (UNLIKELY(!rbuf[i]))
+
+		/* Transpose the encoded sequences so that position j of every */
+		/* pair is one vector */
+		for (j = 0; j < qlen; j++)
+			bq[(size_t)j * lanes + m] = query[j];
+		for (j = 0; j < tlen; j++)
+			bt[(size_t)j * lanes + m] = target[j];
+		if (qlen > gq)
+			gq = qlen;
+		if (tlen > gt)
+			gt = tlen;
+		idx[m++] = i;
+		if (m == lanes)
 		{
-			logerror(lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
-			return 1;
+			score_batch(cp, mat, ctx, frec, rrec, idx, key, m, gq, gt, count);
+			m = 0;
+			gq = 0;
+			gt = 0;
 		}
 	}
+	if (m > 0)
+		score_batch(cp, mat, ctx, frec, rrec, idx, key, m, gq, gt, count);
+
+	return 0;
+}
+
+static bool may_overlap(const CMD *cp, const char *mat, ALIGN_CTX *ctx, const char *query,
+                        int qlen, const char *target, int tlen)
+{
+	bool hit = false;
+	int j = 0;
+	int k = 0;
+	uint64_t x = 0;
+	uint64_t h = 0;
+	uint64_t mask = 0;
+	uint64_t *seeds = ctx->seeds;
+	const uint64_t nbits = SEED_WORDS * 64;
+
+	/* An alignment reaching the minimum score must hold a run of at */
+	/* least k identical bases, unless it is impossible altogether */
+	k = seed_length(cp, mat, qlen < tlen ? qlen : tlen);
+	if (k < 0)
+		return false;
+	if (k < SEED_MIN)
+		return true;
 
-	/* Open input forward fastQ file stream */
-	fin = gzopen(forin, "rb");
-	if (!fin)
+	/* Bases aligned with N score nothing, so they break runs for free */
+	if (memchr(query, 4, qlen) || memchr(target, 4, tlen))
+		return true;
+
+	/* Each k-mer of the target sets two bits of the filter, and each */
+	/* k-mer of the query looks for both; a false hit only costs the */
+	/* batch alignment that follows */
+	mask = k == SEED_MAX ? ~(uint64_t)0 : ((uint64_t)1 << 2 * k) - 1;
+	for (j = 0, x = 0; j < tlen; j++)
 	{
-		errstr = strerror(errno);
-		logerror(lf, "%s:%d Failed to open input forward fastQ file \'%s\': %s.\n",
-		         __func__, __LINE__, forin, errstr);
-		return 1;
+		x = (x << 2 | (uint64_t)target[j]) & mask;
+		if (j < k - 1)
+			continue;
+		h = x * 0x9e3779b97f4a7c15ULL;
+		seeds[(h >> 32) % nbits / 64] |= (uint64_t)1 << (h >> 32) % 64;
+		seeds[(uint32_t)h % nbits / 64] |= (uint64_t)1 << (uint32_t)h % 64;
 	}
-
-	/* Open input reverse fastQ file stream */
-	rin = gzopen(revin, "rb");
-	if (!rin)
+	for (j = 0, x = 0; j < qlen && !hit; j++)
 	{
-		errstr = strerror(errno);
-		logerror(lf, "%s:%d Failed to open input reverse fastQ file \'%s\': %s.\n",
-		         __func__, __LINE__, revin, errstr);
-		return 1;
+		x = (x << 2 | (uint64_t)query[j]) & mask;
+		if (j < k - 1)
+			continue;
+		h = x * 0x9e3779b97f4a7c15ULL;
+		hit = (seeds[(h >> 32) % nbits / 64] >> (h >> 32) % 64 & 1) &&
+		      (seeds[(uint32_t)h % nbits / 64] >> (uint32_t)h % 64 & 1);
 	}
 
-	/* Open output forward fastQ file stream */
-	fout = gzopen(forout, "wb");
-	if (!fout)
+	/* Clear the words that were set, which is cheaper than the whole filter */
+	for (j = 0, x = 0; j < tlen; j++)
 	{
-		logerror(lf, "%s:%d Failed to open forward output fastQ file \'%s\': %s.\n",
-		         __func__, __LINE__, forout, errstr);
-		return 1;
+		x = (x << 2 | (uint64_t)target[j]) & mask;
+		if (j < k - 1)
+			continue;
+		h = x * 0x9e3779b97f4a7c15ULL;
+		seeds[(h >> 32) % nbits / 64] = 0;
+		seeds[(uint32_t)h % nbits / 64] = 0;
 	}
 
-	/* Open output reverse fastQ file stream */
-	rout = gzopen(revout, "wb");
-	if (!rout)
+	return hit;
+}
+
+static int seed_length(const CMD *cp, const char *mat, int len)
+{
+	int b = 0;
+	int k = 0;
+	int bmax = 0;
+	int brk = 0;
+	int loss = 0;
+	int run = 0;
+	const int sa = mat[0];
+	const int sb = -mat[1];
+	const int go = cp->gapo + cp->gape;
+	const int minsc = cp->score;
+
+	if (minsc <= 0 || sa <= 0)
+		return 0;
+
+	/* No alignment holds more matches than the shorter sequence has bases */
+	if (sa * len < minsc)
+		return -1;
+
+	/* An alignment of score S with B mismatches and gaps holds at least */
+	/* (S + B * min(sb, go)) / sa matches in at most B + 1 runs, while each */
+	/* break costs at least min(sa + sb, go) of the best possible score */
+	brk = sb < go ? sb : go;
+	loss = sa + sb < go ? sa + sb : go;
+	if (brk < 0 || loss <= 0)
+		return 0;
+	bmax = (sa * len - minsc) / loss;
+	k = SEED_MAX;
+	for (b = 0; b <= bmax; b++)
 	{
-		errstr = strerror(errno);
-		logerror(lf, "%s:%d Failed to open reverse output fastQ file \'%s\': %s.\n",
-		         __func__, __LINE__, revout, errstr);
-		return 1;
+		run = (minsc + brk * b + sa * (b + 1) - 1) / (sa * (b + 1));
+		if (run < k)
+			k = run;
 	}
 
-	/* Initialize the scoring matrix */
-	for (i = k = 0; i < NBASES; i++)
-	{
-		for (j = 0; j < NBASES; j++)
-			mat[k++] = (i == j) ? sa : -sb;
+	return k;
+}
 
-		/* Ambiguous base */
-		mat[k++] = 0;
-	}
-	for (j = 0; j <= NBASES; j++)
-		mat[k++] = 0;
+static void score_batch(const CMD *cp, const char *mat, ALIGN_CTX *ctx, const FQREC *frec,
+                        FQREC *rrec, const size_t *idx, uint64_t (*key)[2], int m, int qmax,
+                        int tmax, unsigned int *count)
+{
+	int j = 0;
+	int k = 0;
+	int qlen = 0;
+	int tlen = 0;
+	const int lanes = ctx->kern->lanes;
+	unsigned char score[64];
+
+	/* The scoring matrix has one match and one mismatch score; */
+	/* a saturated lane scores 255 and is always aligned in full */
+	ctx->kern->batch(ctx->bq, qmax, ctx->bt, tmax, ctx->bwork, cp->gapo, cp->gape, mat[0],
+	                 -mat[1], score);
 
-	while (1)
+	for (k = 0; k < m; k++)
 	{
-		/* Fill up the forward buffer */
-		for (lc = 0; lc < BSIZE; lc++)
+		if (score[k] >= cp->score || score[k] == 255)
 		{
-			/* Clear the buffer */
-			memset(fbuf[lc], 0, MAX_LINE_LENGTH);
-
-			/* Get line from the fastQ input stream */
-			if (gzgets(fin, fbuf[lc], MAX_LINE_LENGTH) == Z_NULL)
-				break;
+			/* The encoded pair is gathered back out of its lane */
+			/* rather than encoded again */
+			qlen = (int)rrec[idx[k]].seqlen;
+			tlen = (int)frec[idx[k]].seqlen;
+			for (j = 0; j < qlen; j++)
+				ctx->query[j] = (char)ctx->bq[(size_t)j * lanes + k];
+			for (j = 0; j < tlen; j++)
+				ctx->target[j] = (char)ctx->bt[(size_t)j * lanes + k];
+			align_pair(cp, mat, ctx, &frec[idx[k]], &rrec[idx[k]], key[k], count);
 		}
+		else
+			memo_store(ctx, key[k], 0, -1, -1);
+	}
 
-		/* Fill up the reverse buffer */
-		for (lc = 0; lc < BSIZE; lc++)
-		{
-			/* Clear the buffer */
-			memset(rbuf[lc], 0, MAX_LINE_LENGTH);
+	/* Restore the padding for the next batch */
+	memset(ctx->bq, 4, (size_t)qmax * lanes);
+	memset(ctx->bt, 4, (size_t)tmax * lanes);
+}
 
-			/* Get line from the fastQ input stream */
-			if (gzgets(rin, rbuf[lc], MAX_LINE_LENGTH) == Z_NULL)
-				break;
-		}
+static void align_pair(const CMD *cp, const char *mat, ALIGN_CTX *ctx, const FQREC *frec,
+                       FQREC *rrec, const uint64_t *key, unsigned int *count)
+{
+	char *target = NULL;
+	char *query = NULL;
+	int tlen = (int)frec->seqlen;
+	int qlen = (int)rrec->seqlen;
+	int xtra = KSW_XSTART;
+	const int gap_open = cp->gapo;
+	const int gap_extend = cp->gape;
+	const int min_score = cp->score;
+	ALIGN_RESULT r;
 
-		/* Iterate through lines in the buffers */
-		for (l = 0; l < lc; l++)
-		{
-			/* We are at the end of one fastQ entry */
-			if (l % 4 == 3)
-			{
-				ALIGN_RESULT r;
-				char *target = NULL;
-				char *query = NULL;
-				target = strdup(&fbuf[l-2][0]);
-				query = revcom(&rbuf[l-2][0], lf);
-				if (!target || !query)
-					return 1;
-				int tlen = (int)strlen(target);
-				target[tlen] = '\0';
-				int qlen = (int)strlen(query);
-
-				/* Transform sequences */
-				for (i = 0; i < qlen; i++)
-					query[i] = seq_nt4_table[(unsigned char)query[i]];
-				for (i = 0; i < tlen; i++)
-					target[i] = seq_nt4_table[(unsigned char)target[i]];
-
-				/* Do the alignment */
-				r = local_align(qlen, query, tlen, target, mat, gap_open, gap_extend, xtra, lf);
-				free(target);
-				free(query);
-
-				/* Actually trim the sequence */
-				if (r.score >= min_score)
-				{
-					/* Test trimming criterion */
-					if (r.target_begin == 0 && r.query_begin > 0)
-					{
-						int new_end_pos = qlen - r.query_begin;
-						char *seq = &rbuf[l-2][0];
-						char *qual = &rbuf[l][0];
-						seq[new_end_pos] = '\n';
-						seq[new_end_pos+1] = '\0';
-						qual[new_end_pos] = '\n';
-						qual[new_end_pos+1] = '\0';
-						count++;
-					}
-				}
-
-				/* Write sequences to file */
-				gzprintf(fout, "%s%s+\n%s", &fbuf[l-3][0], &fbuf[l-2][0], &fbuf[l][0]);
-				gzprintf(rout, "%s%s+\n%s", &rbuf[l-3][0], &rbuf[l-2][0], &rbuf[l][0]);
-			}
-		}
+	/* The buffers of the context already hold the encoded reverse */
+	/* complement of the reverse sequence and the forward sequence */
+	target = ctx->target;
+	query = ctx->query;
 
-		/* If we are at the end of the file */
-		if (lc < BSIZE)
-			break;
-	}
+	/* Do the alignment; the banded overlap alignment only looks for */
+	/* alignments that start at the first base of either sequence */
+	if (cp->band)
+		r = overlap_align(ctx, qlen, query, tlen, target, mat, gap_open, gap_extend, cp->band,
+		                  min_score);
+	else
+		r = local_align(ctx, qlen, query, tlen, target, mat, gap_open, gap_extend, xtra);
+
+	/* Remember the alignment for the next copy of the pair, then trim */
+	memo_store(ctx, key, r.score, r.query_begin, r.target_begin);
+	trim_mate(cp, rrec, r.score, r.query_begin, r.target_begin, count);
+}
 
-	/* Print informational message to logfile */
-	loginfo(lf, "%u sequences trimmed.\n", count);
+static void pair_key(const FQREC *frec, const FQREC *rrec, uint64_t *key)
+{
+	uint64_t h1 = 0x9e3779b97f4a7c15ULL ^ frec->seqlen;
+	uint64_t h2 = 0xc2b2ae3d27d4eb4fULL ^ rrec->seqlen;
+
+	/* Two independent 64-bit hashes of both sequences stand in for the */
+	/* sequences themselves; the first is never zero, so it also marks */
+	/* the slot as taken */
+	hash_bytes(frec->seq, frec->seqlen, &h1, &h2);
+	hash_bytes(rrec->seq, rrec->seqlen, &h1, &h2);
+	h1 ^= h1 >> 33;
+	h1 *= 0xff51afd7ed558ccdULL;
+	h1 ^= h1 >> 33;
+	h2 ^= h2 >> 29;
+	h2 *= 0xc4ceb9fe1a85ec53ULL;
+	h2 ^= h2 >> 32;
+	key[0] = h1 | 1;
+	key[1] = h2;
+}
+
+static void hash_bytes(const char *s, size_t len, uint64_t *h1, uint64_t *h2)
+{
+	size_t i = 0;
+	uint64_t w = 0;
 
-	/* Free memory from the heap */
-	for (i = 0; i < BSIZE; i++)
+	/* Eight bases at a time, the last word padded with zeros */
+	for (i = 0; i < len; i += 8u)
 	{
-		free(fbuf[i]);
-		free(rbuf[i]);
+		w = 0;
+		memcpy(&w, s + i, len - i < 8u ? len - i : 8u);
+		*h1 = (*h1 ^ w) * 0x87c37b91114253d5ULL;
+		*h1 ^= *h1 >> 31;
+		*h2 = (*h2 + w) * 0x4cf5ad432745937fULL;
+		*h2 = *h2 << 27 | *h2 >> 37;
 	}
-	free(fbuf);
-	free(rbuf);
+}
 
-	/* Close all file streams */
-	gzclose(fin);
-	gzclose(rin);
-	gzclose(fout);
-	gzclose(rout);
+static void memo_store(ALIGN_CTX *ctx, const uint64_t *key, int score, int query_begin,
+                       int target_begin)
+{
+	ALIGN_MEMO *e = &ctx->memo[key[1] & (MEMO_SLOTS - 1)];
 
-	return 0;
+	/* A pair hashed to a taken slot replaces the pair held there */
+	e->key[0] = key[0];
+	e->key[1] = key[1];
+	e->score = score;
+	e->query_begin = query_begin;
+	e->target_begin = target_begin;
+}
+
+static void trim_mate(const CMD *cp, FQREC *rrec, int score, int query_begin, int target_begin,
+                      unsigned int *count)
+{
+	size_t new_end_pos = 0;
+
+	/* Test trimming criterion */
+	if (score >= cp->score && target_begin == 0 && query_begin > 0)
+	{
+		new_end_pos = rrec->seqlen - query_begin;
+		rrec->seqlen = new_end_pos;
+		if (rrec->quallen > new_end_pos)
+			rrec->quallen = new_end_pos;
+		(*count)++;
+	}
 }
@@ -0,0 +1,95 @@
+/* file: arena.c
+ * description: Chunked bump allocator for records freed all at once
+ * author: Daniel Garrigan Lummei Analytics LLC
+ * updated: November 2016
+ * email: dgarriga@lummei.net
+ * copyright: MIT license
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "ddradseq.h"
+
+/* Every allocation is aligned for the record structures stored in it */
+#define ARENA_ALIGN sizeof(void*)
+
+ARENA *arena_create(FILE *lf)
+{
+	ARENA *a = NULL;
+
+	a = calloc(1, sizeof(ARENA));
+	if (UNLIKELY(!a))
+	{
+		logerror(lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
+		return NULL;
+	}
+	a->lf = lf;
+	return a;
+}
+
+void *arena_alloc(ARENA *a, size_t n)
+{
+	char *chunk = NULL;
+	size_t size = ARENA_CHUNK;
+	size_t head = (sizeof(char*) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+	void *p = NULL;
+
+	n = (n + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+	/* Start a new chunk when the request does not fit the current one; */
+	/* each chunk begins with a pointer to the previous chunk */
+	if (!a->chunk || a->used + n > a->size)
+	{
+		if (head + n > size)
+			size = head + n;
+		chunk = malloc(size);
+		if (UNLIKELY(!chunk))
+		{
+			logerror(a->lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
+			return NULL;
+		}
+		*(char**)chunk = a->chunk;
+		a->chunk = chunk;
+		a->used = head;
+		a->size = size;
+		a->nbytes += size;
+	}
+	p = a->chunk + a->used;
+	a->used += n;
+	return p;
+}
+
+void arena_reset(ARENA *a)
+{
+	char *prev = NULL;
+	size_t head = (sizeof(char*) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+	if (!a->chunk)
+		return;
+
+	/* Free all but the current chunk, which is reused from its start */
+	prev = *(char**)a->chunk;
+	while (prev)
+	{
+		*(char**)a->chunk = *(char**)prev;
+		free(prev);
+		prev = *(char**)a->chunk;
+	}
+	a->used = head;
+	a->nbytes = a->size;
+}
+
+void arena_destroy(ARENA *a)
+{
+	char *prev = NULL;
+
+	if (!a)
+		return;
+	while (a->chunk)
+	{
+		prev = *(char**)a->chunk;
+		free(a->chunk);
+		a->chunk = prev;
+	}
+	free(a);
+}
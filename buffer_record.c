@@ -0,0 +1,58 @@
+/* file: buffer_record.c
+ * description: Appends a fastQ entry to a sample output buffer
+ * author: Daniel Garrigan Lummei Analytics LLC
+ * updated: November 2016
+ * email: dgarriga@lummei.net
+ * copyright: MIT license
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ddradseq.h"
+
+int buffer_record(const CMD *cp, int orient, BARCODE *bc, const FQREC *rec, size_t trim)
+{
+	char *q = NULL;
+	int ret = 0;
+	size_t seqlen = rec->seqlen - trim;
+	size_t quallen = rec->quallen - trim;
+	size_t add_bytes = rec->idlen + seqlen + quallen + 6u;
+	FILE *lf = cp->lf;
+
+	if (add_bytes >= BUFLEN)
+	{
+		logerror(lf, "%s:%d fastQ entry is larger than the output buffer.\n",
+		         __func__, __LINE__);
+		return 1;
+	}
+
+	/* Write out the buffer if the entry does not fit */
+	if ((bc->curr_bytes[orient] + add_bytes) >= BUFLEN)
+	{
+		ret = flush_buffer(cp, orient, bc);
+		if (ret)
+		{
+			logerror(lf, "%s:%d Problem writing buffer to file.\n", __func__, __LINE__);
+			return 1;
+		}
+	}
+
+	/* Copy the lines straight from the input record */
+	q = bc->buffer[orient] + bc->curr_bytes[orient];
+	*q++ = '@';
+	memcpy(q, rec->id, rec->idlen);
+	q += rec->idlen;
+	*q++ = '\n';
+	memcpy(q, rec->seq + trim, seqlen);
+	q += seqlen;
+	memcpy(q, "\n+\n", 3u);
+	q += 3u;
+	memcpy(q, rec->qual + trim, quallen);
+	q += quallen;
+	*q++ = '\n';
+	*q = '\0';
+	bc->curr_bytes[orient] += add_bytes;
+
+	return 0;
+}
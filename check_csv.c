@@ -10,59 +10,60 @@
 #include <stdlib.h>
 #include <stddef.h>
 #include <string.h>
-#include <zlib.h>
 #include "ddradseq.h"
 
 static int compare(const void *a, const void *b);
 
 int check_csv(const CMD *cp)
 {
-	char buf[MAX_LINE_LENGTH];
+	char *buf = NULL;
 	char **list = NULL;
+	char **tmp = NULL;
 	char *p = NULL;
 	char *q = NULL;
+	long len = 0;
 	unsigned int i = 0;
 	unsigned int nlines = 0;
+	unsigned int nalloc = 0;
+	size_t bufcap = 0;
 	ptrdiff_t diffp;
 	ptrdiff_t diffq;
 	FILE *lf = cp->lf;
-	gzFile in;
+	INSTREAM *in = NULL;
 
-	in = gzopen(cp->csvfile, "rb");
+	in = instream_open(cp->csvfile, lf);
 	if (!in)
 	{
 		logerror(lf, "%s:%d Could not read CSV database file %s into memory.\n",
 			     __func__, __LINE__, cp->csvfile);
-		return 1;;
-	}
-
-	/* Read CSV and count the number of entries */
-	while (gzgets(in, buf, MAX_LINE_LENGTH) != Z_NULL)
-		nlines++;
-
-	/* Allocate memory for list from heap */
-	list = malloc(nlines * sizeof(char*));
-	if (UNLIKELY(!list))
-	{
-		logerror(lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
 		return 1;
 	}
-	for (i = 0; i < nlines; i++)
+
+	/* Read the CSV lines into a list that doubles as needed */
+	while ((len = instream_getline(in, &buf, &bufcap)) > 0)
 	{
-		list[i] = malloc(MAX_LINE_LENGTH);
-		if (UNLIKELY(!list[i]))
+		if (nlines == nalloc)
+		{
+			nalloc = nalloc ? 2u * nalloc : 64u;
+			tmp = realloc(list, nalloc * sizeof(char*));
+			if (UNLIKELY(!tmp))
+			{
+				logerror(lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
+				return 1;
+			}
+			list = tmp;
+		}
+		list[nlines] = strdup(buf);
+		if (UNLIKELY(!list[nlines]))
 		{
 			logerror(lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
 			return 1;
 		}
+		nlines++;
 	}
-
-	/* Rewind input stream */
-	gzrewind(in);
-
-	/* Populate the list of lines */
-	for (i = 0; i < nlines; i++)
-		gzgets(in, list[i], MAX_LINE_LENGTH);
+	free(buf);
+	if (len < 0)
+		return 1;
 
 	/* Sort the list */
 	qsort(list, nlines, sizeof(char*), compare);
@@ -100,7 +101,7 @@ int check_csv(const CMD *cp)
 	}
 
 	/* Close input file stream */
-	gzclose(in);
+	instream_close(in);
 
 	/* Deallocate heap memory */
 	for (i = 0; i < nlines; i++)
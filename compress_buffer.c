@@ -0,0 +1,192 @@
+/* file: compress_buffer.c
+ * description: Compresses a block of data into a self-contained gzip member or Zstandard frame
+ * author: Daniel Garrigan Lummei Analytics LLC
+ * updated: November 2016
+ * email: dgarriga@lummei.net
+ * copyright: MIT license
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <zlib.h>
+#ifdef HAVE_LIBDEFLATE
+#include <libdeflate.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#include "ddradseq.h"
+
+/* Function prototypes */
+static size_t gzip_bound(size_t len);
+static long gzip_compress(const char *in, size_t len, char *out, size_t cap, int level);
+static long zstd_compress(const char *in, size_t len, char *out, size_t cap, int level);
+
+size_t compress_bound(size_t len, int format)
+{
+#ifdef HAVE_ZSTD
+	if (format == ZSTD_FORMAT)
+		return ZSTD_compressBound(len);
+#endif
+	return gzip_bound(len);
+}
+
+long compress_buffer(const char *in, size_t len, char *out, size_t cap, int level, int format)
+{
+	if (format == ZSTD_FORMAT)
+		return zstd_compress(in, len, out, cap, level);
+	return gzip_compress(in, len, out, cap, level);
+}
+
+#ifdef HAVE_ZSTD
+
+/* The compression context is kept between calls to avoid re-allocating it */
+static __thread ZSTD_CCtx *cctx = NULL;
+
+static long zstd_compress(const char *in, size_t len, char *out, size_t cap, int level)
+{
+	size_t nc = 0;
+
+	if (!cctx)
+	{
+		cctx = ZSTD_createCCtx();
+		if (!cctx)
+			return -1;
+	}
+	if (ZSTD_isError(ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level)))
+		return -1;
+	nc = ZSTD_compress2(cctx, out, cap, in, len);
+	if (ZSTD_isError(nc))
+		return -1;
+	return (long)nc;
+}
+
+#else
+
+static long zstd_compress(const char *in, size_t len, char *out, size_t cap, int level)
+{
+	/* Zstandard output is rejected on the command line without support */
+	return -1;
+}
+
+#endif
+
+#ifdef HAVE_LIBDEFLATE
+
+/* One compressor per level is kept between calls */
+static __thread struct libdeflate_compressor *comp[MAX_LEVEL + 1];
+
+/* Function prototypes */
+static struct libdeflate_compressor *get_compressor(int level);
+
+static size_t gzip_bound(size_t len)
+{
+	struct libdeflate_compressor *c = get_compressor(1);
+
+	/* Fall back to a bound that holds for stored blocks of any size */
+	if (!c)
+		return len + 5u * (len / 4096u + 1u) + 64u;
+	return libdeflate_gzip_compress_bound(c, len);
+}
+
+static long gzip_compress(const char *in, size_t len, char *out, size_t cap, int level)
+{
+	size_t nc = 0;
+	struct libdeflate_compressor *c = get_compressor(level);
+
+	if (!c)
+		return -1;
+	nc = libdeflate_gzip_compress(c, in, len, out, cap);
+	if (nc == 0)
+		return -1;
+	return (long)nc;
+}
+
+static struct libdeflate_compressor *get_compressor(int level)
+{
+	if (level < 0 || level > MAX_LEVEL)
+		return NULL;
+	if (!comp[level])
+		comp[level] = libdeflate_alloc_compressor(level);
+	return comp[level];
+}
+
+#else
+
+/* Window bits value that selects the gzip wrapper */
+#define GZIP_WBITS 31
+
+/* The deflate state is kept between calls to avoid re-allocating it */
+static __thread z_stream strm;
+static __thread bool strm_init = false;
+static __thread int strm_level = 0;
+
+static size_t gzip_bound(size_t len)
+{
+	/* zlib bound plus the difference between gzip and zlib wrappers */
+	return compressBound(len) + 12u;
+}
+
+static long gzip_compress(const char *in, size_t len, char *out, size_t cap, int level)
+{
+	int ret = 0;
+
+	if (!strm_init)
+	{
+		memset(&strm, 0, sizeof(z_stream));
+		ret = deflateInit2(&strm, level, Z_DEFLATED, GZIP_WBITS, 8, Z_DEFAULT_STRATEGY);
+		if (ret != Z_OK)
+			return -1;
+		strm_init = true;
+		strm_level = level;
+	}
+	else if (deflateReset(&strm) != Z_OK)
+		return -1;
+
+	/* A freshly reset stream can switch levels without flushing anything */
+	if (level != strm_level)
+	{
+		if (deflateParams(&strm, level, Z_DEFAULT_STRATEGY) != Z_OK)
+			return -1;
+		strm_level = level;
+	}
+
+	strm.next_in = (unsigned char*)in;
+	strm.avail_in = len;
+	strm.next_out = (unsigned char*)out;
+	strm.avail_out = cap;
+	ret = deflate(&strm, Z_FINISH);
+	if (ret != Z_STREAM_END)
+		return -1;
+	return (long)(cap - strm.avail_out);
+}
+
+#endif
+
+void compress_free(void)
+{
+#ifdef HAVE_LIBDEFLATE
+	int i = 0;
+#endif
+
+	/* The state is created again on the next call, if there is one */
+#ifdef HAVE_ZSTD
+	ZSTD_freeCCtx(cctx);
+	cctx = NULL;
+#endif
+#ifdef HAVE_LIBDEFLATE
+	for (i = 0; i <= MAX_LEVEL; i++)
+	{
+		libdeflate_free_compressor(comp[i]);
+		comp[i] = NULL;
+	}
+#else
+	if (strm_init)
+	{
+		deflateEnd(&strm);
+		strm_init = false;
+	}
+#endif
+}
@@ -8,6 +8,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdbool.h>
 #include <unistd.h>
 #include <errno.h>
@@ -18,6 +19,9 @@
 #include "khash.h"
 #include "ddradseq.h"
 
+/* Function prototypes */
+static bool own_partfile(const CMD *cp, const char *fname);
+
 int create_dirtree(const CMD *cp, const khash_t(pool_hash) *h)
 {
 	char *pooldir = NULL;
@@ -59,7 +63,8 @@ int create_dirtree(const CMD *cp, const khash_t(pool_hash) *h)
 		{
 			status = mkdir(cp->outdir, S_IRWXU | S_IRGRP | S_IXGRP |
 									   S_IROTH | S_IXOTH);
-			if (status < 0)
+			/* Concurrent parse processes may race to create it */
+			if (status < 0 && errno != EEXIST)
 			{
 				errstr = strerror(errno);
 				logerror(lf, "%s:%d Failed to create output directory \'%s\': %s.\n",
@@ -98,7 +103,7 @@ int create_dirtree(const CMD *cp, const khash_t(pool_hash) *h)
 					{
 						status = mkdir(flowdir, S_IRWXU | S_IRGRP | S_IXGRP |
 												S_IROTH | S_IXOTH);
-						if (status < 0)
+						if (status < 0 && errno != EEXIST)
 						{
 							errstr = strerror(errno);
 							logerror(lf, "%s:%d Failed to create flowcell-level output "
@@ -133,7 +138,7 @@ int create_dirtree(const CMD *cp, const khash_t(pool_hash) *h)
 						{
 							status = mkdir(pooldir, S_IRWXU | S_IRGRP |
 													S_IXGRP | S_IROTH | S_IXOTH);
-							if (status < 0)
+							if (status < 0 && errno != EEXIST)
 							{
 								char *errstr = strerror(errno);
 								logerror(lf, "%s:%d Failed to create pool-level "
@@ -158,8 +163,12 @@ int create_dirtree(const CMD *cp, const khash_t(pool_hash) *h)
 						if (d)
 						{
 							/* If directory already exists-- delete all files */
+							/* In part mode other writers share the directory, */
+							/* so only this writer's own part files are deleted */
 							while ((next_file = readdir(d)) != NULL)
 							{
+								if (cp->part && !own_partfile(cp, next_file->d_name))
+									continue;
 								sprintf(filepath, "%s/%s", parsedir, next_file->d_name);
 								remove(filepath);
 							}
@@ -169,7 +178,7 @@ int create_dirtree(const CMD *cp, const khash_t(pool_hash) *h)
 						{
 							status = mkdir(parsedir, S_IRWXU | S_IRGRP |
 													 S_IXGRP | S_IROTH | S_IXOTH);
-							if (status < 0)
+							if (status < 0 && errno != EEXIST)
 							{
 								char *errstr = strerror(errno);
 								logerror(lf, "%s:%d Failed to create parse directory "
@@ -202,7 +211,7 @@ int create_dirtree(const CMD *cp, const khash_t(pool_hash) *h)
 						if (d)
 						{
 							/* If directory already exists-- delete all files */
-							while ((next_file = readdir(d)) != NULL)
+							while (!cp->part && (next_file = readdir(d)) != NULL)
 							{
 								sprintf(filepath, "%s/%s", pairdir, next_file->d_name);
 								remove(filepath);
@@ -213,7 +222,7 @@ int create_dirtree(const CMD *cp, const khash_t(pool_hash) *h)
 						{
 							status = mkdir(pairdir, S_IRWXU | S_IRGRP |
 													S_IXGRP | S_IROTH | S_IXOTH);
-							if (status < 0)
+							if (status < 0 && errno != EEXIST)
 							{
 								char *errstr = strerror(errno);
 								logerror(lf, "%s:%d Failed to create pairs directory "
@@ -246,7 +255,7 @@ int create_dirtree(const CMD *cp, const khash_t(pool_hash) *h)
 						if (d)
 						{
 							/* If directory already exists-- delete all files */
-							while ((next_file = readdir(d)) != NULL)
+							while (!cp->part && (next_file = readdir(d)) != NULL)
 							{
 								sprintf(filepath, "%s/%s", trimdir, next_file->d_name);
 								remove(filepath);
@@ -257,7 +266,7 @@ int create_dirtree(const CMD *cp, const khash_t(pool_hash) *h)
 						{
 							status = mkdir(trimdir, S_IRWXU | S_IRGRP |
 													S_IXGRP | S_IROTH | S_IXOTH);
-							if (status < 0)
+							if (status < 0 && errno != EEXIST)
 							{
 								char *errstr = strerror(errno);
 								logerror(lf, "%s:%d Failed to create final directory "
@@ -281,3 +290,17 @@ int create_dirtree(const CMD *cp, const khash_t(pool_hash) *h)
 	}
 	return 0;
 }
+
+static bool own_partfile(const CMD *cp, const char *fname)
+{
+	const char *p = strstr(fname, ".part-");
+
+	/* Match the ".part-<tag>.fq.gz" or ".part-<tag>.fq.zst" suffix of this writer */
+	if (!p)
+		return false;
+	p += 6;
+	if (strncmp(p, cp->part, strlen(cp->part)) != 0)
+		return false;
+	p += strlen(cp->part);
+	return string_equal(p, ".fq.gz") || string_equal(p, ".fq.zst");
+}
@@ -10,6 +10,7 @@
 
 /* Function prototypes */
 extern int parse_main(const CMD*);
+extern int merge_main(const CMD*);
 extern int trimend_main(const CMD*);
 extern int pair_main(const CMD*);
 
@@ -28,6 +29,10 @@ int main(int argc, char *argv[])
 	if (ret)
 		return 1;
 
+	/* Set up asynchronous output writes */
+	if (cp->aio_depth > 0)
+		aio_init(cp->aio_depth, cp->lf);
+
 	/* Run the parse pipeline stage */
 	if (string_equal(cp->mode, "parse") || string_equal(cp->mode, "all"))
 	{
@@ -36,6 +41,14 @@ int main(int argc, char *argv[])
 			return 1;
 	}
 
+	/* Merge part files written by separate parse processes */
+	if (string_equal(cp->mode, "merge"))
+	{
+		ret = merge_main(cp);
+		if (ret)
+			return 1;
+	}
+
 	/* Run the pair pipeline stage */
 	if (string_equal(cp->mode, "pair") || string_equal(cp->mode, "all"))
 	{
@@ -52,6 +65,12 @@ int main(int argc, char *argv[])
 			return 1;
 	}
 
+	/* Tear down asynchronous output writes and release the */
+	/* compression state of the main thread */
+	aio_destroy();
+	compress_free();
+	write_block_free();
+
 	/* Free memory for command line data structure from heap */
 	destroy_cmdline(cp);
 
@@ -18,7 +18,10 @@
 #include <string.h>
 #include <stdarg.h>
 #include <stdbool.h>
-#include <emmintrin.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <zlib.h>
 #include "khash.h"
 
 #ifdef __GNUC__
@@ -35,17 +38,17 @@
 
 #define BUFLEN 0x20000
 
-/** @def MAX_LINE_LENGTH
- *  @brief Maximum line length to read from input file.
+/** @def ARENA_CHUNK
+ *  @brief Size of the chunks allocated by a record arena.
  */
 
-#define MAX_LINE_LENGTH 400
+#define ARENA_CHUNK 0x400000
 
-/** @def BSIZE
- *  @brief Number of lines in individual parse buffers.
+/** @def PAIR_MEM_MIN
+ *  @brief Smallest pairing memory budget in megabytes, which holds one arena chunk.
  */
 
-#define BSIZE 4000
+#define PAIR_MEM_MIN (ARENA_CHUNK >> 20)
 
 /** @def DNAME_LENGTH
  *  @brief Length of terminal output directory name.
@@ -54,16 +57,16 @@
 #define DNAME_LENGTH 5
 
 /** @def FORWARD
- *  @brief Identifier for forward-oriented reads.
+ *  @brief Identifier for forward-oriented reads, which also indexes per-mate arrays.
  */
 
-#define FORWARD 1
+#define FORWARD 0
 
 /** @def REVERSE
- *  @brief Identifier for reverse-oriented reads.
+ *  @brief Identifier for reverse-oriented reads, which also indexes per-mate arrays.
  */
 
-#define REVERSE 2
+#define REVERSE 1
 
 /** @def DATELEN
  *  @brief Length of data format YYYY-DD-MM.
@@ -71,6 +74,34 @@
 
 #define DATELEN 20
 
+/** @def GZIP_FORMAT
+ *  @brief Identifier for gzip-compressed output files.
+ */
+
+#define GZIP_FORMAT 1
+
+/** @def ZSTD_FORMAT
+ *  @brief Identifier for Zstandard-compressed output files.
+ */
+
+#define ZSTD_FORMAT 2
+
+/** @def MAX_ZSTD_LEVEL
+ *  @brief Highest supported Zstandard output compression level.
+ */
+
+#define MAX_ZSTD_LEVEL 19
+
+/** @def MAX_LEVEL
+ *  @brief Highest supported output compression level.
+ */
+
+#ifdef HAVE_LIBDEFLATE
+#define MAX_LEVEL 12
+#else
+#define MAX_LEVEL 9
+#endif
+
 /** @def KSW_XBYTE
  *  @brief
  */
@@ -95,6 +126,18 @@
 
 #define KSW_XSTART 0x80000
 
+/** @def SEED_WORDS
+ *  @brief Number of 64-bit words in the k-mer filter of an aligning thread.
+ */
+
+#define SEED_WORDS 1024
+
+/** @def MEMO_SLOTS
+ *  @brief Number of read pairs remembered by the alignment cache of an aligning thread.
+ */
+
+#define MEMO_SLOTS 65536
+
 
 /******************************************************
  * Data structure defintions
@@ -108,29 +151,58 @@ typedef struct cmdparam_t
 {
 	bool across;          /**< Flag to pool sequences across flow cells. */
 	bool mt_mode;         /**< Flag to indicate multi-threaded mode. */
+	bool interleaved;     /**< Flag to indicate that each input file holds both mates of its pairs. */
 	char *parent_indir;   /**< String holding the full path and name of the parent input directory. */
 	char *parent_outdir;  /**< String holding the full path to the parent output directory. */
 	char *outdir;         /**< String holding the full path to the output directory. */
 	char *csvfile;        /**< String holding the full path of the CSV database input file. */
 	char *mode;           /**< String holding the run-time mode of the program. */
 	char *glob;           /**< String holding the input fastQ file glob expression. */
+	char *part;           /**< String holding the tag of this writer's parse part files. */
+	char *r1;             /**< String holding the forward input file, pipe or NULL to search the input directory. */
+	char *r2;             /**< String holding the reverse input file, pipe or NULL if absent or interleaved. */
+	char *flowcell;       /**< String holding the flow cell of the input streams or NULL to read it from each entry. */
+	char *lane;           /**< String holding the lane of the input streams or NULL. */
 	int dist;             /**< The allowable edit distance for a barcode match. */
 	int score;            /**< The alignment score to consider mates properly paired. */
 	int gapo;             /**< The penalty for opening an alignment gap. */
 	int gape;             /**< The penalty for extending an open alignment gap. */
+	int band;             /**< The diagonals either side of the mate overlap that gaps may reach (zero for a full local alignment). */
 	int nthreads;         /**< The number of threads to use for parallel computation. */
+	int aio_depth;        /**< The number of asynchronous output writes in flight (zero for synchronous writes). */
+	int prefetch;         /**< The megabytes of the next input files read ahead into the page cache (zero to disable). */
+	int pair_mem;         /**< The megabytes of forward entries held while pairing before sorting to disk (zero for no limit). */
+	int parse_level;      /**< The compression level of parse output files. */
+	int pair_level;       /**< The compression level of pair output files. */
+	int final_level;      /**< The compression level of final output files. */
+	int format;           /**< The compression format of output files. */
 	FILE *lf;             /**< Pointer to the log file output stream. */
 } CMD;
 
+/** @var typedef struct arena_t ARENA
+ *  @brief Data structure for a chunked allocator whose records are freed all at once.
+ */
+
+typedef struct arena_t
+{
+	char *chunk;    /**< The current chunk, which begins with a pointer to the previous chunk. */
+	size_t used;    /**< The number of bytes used in the current chunk. */
+	size_t size;    /**< The size of the current chunk. */
+	size_t nbytes;  /**< The total size of all chunks. */
+	FILE *lf;       /**< Pointer to the log file output stream. */
+} ARENA;
+
 /** @var typedef struct fastq_t FASTQ
- *  @brief Data structure to hold a single fastQ entry.
+ *  @brief Data structure to hold a single fastQ entry in an arena.
+ *  @note The lines are stored back to back behind the lengths, each NUL-terminated.
  */
 
 typedef struct fastq_t
 {
-	char *id;       /**< String holding the Illumina identifier line for a fastQ entry. */
-	char *seq;      /**< String holding the DNA sequence line for a fastQ entry. */
-	char *qual;     /**< String holding the DNA sequence quality line for a fastQ entry. */
+	unsigned int idlen;   /**< The length of the Illumina identifier line. */
+	unsigned int seqlen;  /**< The length of the DNA sequence line. */
+	unsigned int quallen; /**< The length of the DNA sequence quality line. */
+	char text[];          /**< The identifier, sequence and quality lines followed by the hash key. */
 } FASTQ;
 
 
@@ -150,6 +222,19 @@ typedef struct ksqr_t
 } ALIGN_RESULT;
 
 
+/** @var typedef struct align_memo_t ALIGN_MEMO
+ *  @brief Data structure for the trim decision of one read pair in the alignment cache.
+ */
+
+typedef struct align_memo_t
+{
+	uint64_t key[2];    /**< Hash of the forward and reverse sequences; zero marks an empty slot. */
+	int score;          /**< The score of the overlap alignment, or zero if the pair was passed over. */
+	int target_begin;   /**< The position on the forward sequence where the alignment begins. */
+	int query_begin;    /**< The position on the reverse complement where the alignment begins. */
+} ALIGN_MEMO;
+
+
 /** @var typedef struct kswq_t ALIGN_QUERY
  *  @brief Data structure to hold align query parameters.
  */
@@ -161,14 +246,256 @@ typedef struct kswq_t
     unsigned char shift;
     unsigned char mdiff;
     unsigned char max;
-    __m128i *qp;
-    __m128i *H0;
-    __m128i *H1;
-    __m128i *E;
-    __m128i *Hmax;
+    unsigned char size;
+    void *qp;
+    void *H0;
+    void *H1;
+    void *E;
+    void *Hmax;
 } ALIGN_QUERY;
 
 
+/** @var typedef struct align_ctx_t ALIGN_CTX
+ *  @brief Data structure for the buffers of an aligning thread, reused from pair to pair.
+ *  @note The buffers only grow, to fit the longest sequences seen so far.
+ */
+
+typedef struct align_ctx_t
+{
+	ALIGN_QUERY *q;     /**< The query profile and score vectors. */
+	int qcap;           /**< The longest query the profile can hold. */
+	uint64_t *b;        /**< The best scores by target position, one slot per position. */
+	int tcap;           /**< The longest target the score slots can hold. */
+	char *query;        /**< The encoded query sequence. */
+	char *target;       /**< The encoded target sequence. */
+	unsigned char *bq;  /**< The queries of a batch, transposed one pair per lane. */
+	unsigned char *bt;  /**< The targets of a batch, transposed one pair per lane. */
+	void *bwork;        /**< The score vectors of the batch kernel. */
+	void *bmem;         /**< The memory behind the batch buffers. */
+	int bcap;           /**< The longest sequence the batch buffers can hold. */
+	int *band;          /**< The score rows of the banded overlap alignment. */
+	int bandcap;        /**< The widest band the score rows can hold. */
+	uint64_t seeds[SEED_WORDS]; /**< Bloom filter of the k-mers of one target, left empty between pairs. */
+	ALIGN_MEMO *memo;   /**< The trim decisions of recent read pairs, indexed by hash. */
+	unsigned long memo_hits;    /**< The number of read pairs answered by the cache. */
+	unsigned long memo_pairs;   /**< The number of read pairs looked up in the cache. */
+	const struct align_kernel_t *kern; /**< The kernels for the vector width of the processor. */
+	FILE *lf;           /**< Pointer to the log file output stream. */
+} ALIGN_CTX;
+
+
+/** @var typedef struct align_kernel_t ALIGN_KERNEL
+ *  @brief Data structure for the Smith-Waterman kernels of one vector width.
+ */
+
+typedef struct align_kernel_t
+{
+	const char *name;   /**< The instruction set of the kernels. */
+	int lanes;          /**< The number of pairs scored at once by the batch kernel. */
+	ALIGN_QUERY *(*init)(ALIGN_CTX *ctx, int qlen, const char *query, const char *mat, int size); /**< Builds the query profile. */
+	ALIGN_RESULT (*sw8)(ALIGN_CTX *ctx, ALIGN_QUERY *q, int tlen, const char *target, int gapo, int gape, int xtra); /**< Aligns with 8-bit cells. */
+	ALIGN_RESULT (*sw16)(ALIGN_CTX *ctx, ALIGN_QUERY *q, int tlen, const char *target, int gapo, int gape, int xtra); /**< Aligns with 16-bit cells. */
+	void (*batch)(const void *bq, int qlen, const void *bt, int tlen, void *work, int gapo, int gape, int sa, int sb, unsigned char *score); /**< Scores a batch of pairs, one per lane. */
+} ALIGN_KERNEL;
+
+
+/** @var typedef struct writer_t WRITER
+ *  @brief Data structure for a block-buffered compressed output file.
+ */
+
+typedef struct writer_t
+{
+	int fd;         /**< The output file descriptor. */
+	off_t offset;   /**< The file offset of the next compressed block. */
+	char *buf;      /**< The uncompressed block buffer. */
+	size_t len;     /**< The number of bytes currently in the block buffer. */
+	int level;      /**< The compression level of the output file. */
+	int format;     /**< The compression format of the output file. */
+	void *zc;       /**< The Zstandard compression stream or NULL. */
+	char *zbuf;     /**< The compressed output buffer of the Zstandard stream. */
+	size_t zcap;    /**< The capacity of the compressed output buffer. */
+	bool packed;    /**< Flag set once blocks compressed by writer_pack have been appended. */
+	FILE *lf;       /**< Pointer to the log file output stream. */
+} WRITER;
+
+
+/** @var typedef struct instream_t INSTREAM
+ *  @brief Data structure for a compressed input file.
+ */
+
+typedef struct instream_t
+{
+	z_stream *zs;   /**< The gzip decompression stream or NULL. */
+	void *zd;       /**< The Zstandard decompression stream or NULL. */
+	int fd;         /**< The input file descriptor. */
+	int format;     /**< The compression format of the input or zero if uncompressed. */
+	bool pipe;      /**< Flag set when the input is not a regular file. */
+	bool probed;    /**< Flag set once the compression format has been identified. */
+	char *filename; /**< The input file name for messages. */
+	char *ibuf;     /**< The input buffer holding data as read from the file. */
+	size_t ipos;    /**< The position of the next unread input byte. */
+	size_t ilen;    /**< The number of bytes in the input buffer. */
+	char *obuf;     /**< The output buffer holding decompressed data. */
+	size_t opos;    /**< The position of the next unread decompressed byte. */
+	size_t olen;    /**< The number of bytes in the decompressed output buffer. */
+	bool ieof;      /**< Flag set when the end of the input file was read. */
+	bool midframe;  /**< Flag set while a gzip member or Zstandard frame is only partly decoded. */
+	bool eof;       /**< Flag set when the decompressed stream has ended. */
+	FILE *lf;       /**< Pointer to the log file output stream. */
+} INSTREAM;
+
+
+/** @var typedef struct fqrec_t FQREC
+ *  @brief View of a single fastQ record held in a READER buffer.
+ *  @note The lines are not NUL-terminated and must be read by length.
+ */
+
+typedef struct fqrec_t
+{
+	const char *id;  /**< The identifier line without the leading '@'. */
+	size_t idlen;    /**< The length of the identifier line. */
+	const char *seq; /**< The DNA sequence. */
+	size_t seqlen;   /**< The length of the DNA sequence. */
+	const char *qual;/**< The quality sequence. */
+	size_t quallen;  /**< The length of the quality sequence. */
+} FQREC;
+
+
+/** @var typedef struct reader_t READER
+ *  @brief Data structure for a block-buffered fastQ record reader.
+ */
+
+typedef struct reader_t
+{
+	INSTREAM *in;   /**< The decompressed input stream or NULL if mapped. */
+	char *buf;      /**< The block buffer holding decompressed records. */
+	size_t cap;     /**< The capacity of the block buffer. */
+	size_t pos;     /**< The position of the next record in the block buffer. */
+	size_t len;     /**< The number of bytes in the block buffer. */
+	bool eof;       /**< Flag set when the input stream has ended. */
+	bool mapped;    /**< Flag set when the buffer is a mapping of the input file. */
+	FILE *lf;       /**< Pointer to the log file output stream. */
+} READER;
+
+
+/** @var typedef struct pairtask_t PAIRTASK
+ *  @brief Data structure for pairing the mates of one sample.
+ */
+
+typedef struct pairtask_t
+{
+	char *fin;          /**< The forward parse file of the sample. */
+	char *rin;          /**< The reverse parse file of the sample. */
+	char *ffor;         /**< The forward pairs output file. */
+	char *frev;         /**< The reverse pairs output file. */
+	off_t size;         /**< The combined size of the input files. */
+	size_t mem;         /**< The memory the task may need if its mates are out of order. */
+	bool taken;         /**< Flag set once a thread has started on the task. */
+} PAIRTASK;
+
+
+/** @var typedef struct pairpool_t PAIRPOOL
+ *  @brief Data structure for the threads pairing samples concurrently.
+ */
+
+typedef struct pairpool_t
+{
+	const CMD *cp;          /**< Pointer to command line data structure. */
+	PAIRTASK *task;         /**< The tasks, largest first. */
+	unsigned int ntasks;    /**< The number of tasks. */
+	unsigned int running;   /**< The number of tasks in progress. */
+	int wthreads;           /**< The compression threads of each output file. */
+	size_t used;            /**< The memory claimed by the tasks in progress. */
+	size_t budget;          /**< The memory the tasks in progress may claim together. */
+	bool failed;            /**< Flag set once a task has failed. */
+	pthread_mutex_t lock;   /**< Lock guarding the scheduling state. */
+	pthread_cond_t cond;    /**< Signalled whenever a task finishes. */
+} PAIRPOOL;
+
+
+/** @var typedef struct trimbatch_t TRIMBATCH
+ *  @brief Data structure for a run of consecutive read pairs of one sample.
+ */
+
+typedef struct trimbatch_t
+{
+	unsigned long seq;          /**< The position of the batch within its sample. */
+	size_t n;                   /**< The number of read pairs in the batch. */
+	FQREC *frec;                /**< The forward entries. */
+	FQREC *rrec;                /**< The reverse entries. */
+	ARENA *arena;               /**< The arena holding copies of the entries. */
+	char *text;                 /**< Block buffer in which entries are formatted for compression. */
+	char *out;                  /**< The compressed reverse output. */
+	size_t outlen;              /**< The length of the compressed output. */
+	size_t outcap;              /**< The capacity of the compressed output buffer. */
+	struct trimbatch_t *next;   /**< The next batch waiting to be written or reused. */
+} TRIMBATCH;
+
+
+/** @var typedef struct trimjob_t TRIMJOB
+ *  @brief Data structure for trimming the reverse reads of one sample.
+ *  @note Only the thread holding the task of a sample reads its input files.
+ */
+
+typedef struct trimjob_t
+{
+	char *fin;                  /**< The forward pairs file of the sample. */
+	char *rin;                  /**< The reverse pairs file of the sample. */
+	char *ffor;                 /**< The forward final output file, passed through from its input. */
+	char *frev;                 /**< The reverse final output file. */
+	off_t size;                 /**< The combined size of the input files. */
+	READER *fr;                 /**< The forward input stream once opened. */
+	READER *rr;                 /**< The reverse input stream once opened. */
+	WRITER *rout;               /**< The reverse output stream once opened. */
+	unsigned long nread;        /**< The number of batches read. */
+	unsigned long nwritten;     /**< The number of batches written. */
+	unsigned int count;         /**< The number of reverse sequences trimmed. */
+	bool eof;                   /**< Flag set once the last batch has been read. */
+	bool failed;                /**< Flag set once any task has failed, to release waiting threads. */
+	TRIMBATCH *waiting;         /**< Aligned batches waiting for earlier ones, in order. */
+	TRIMBATCH *spare;           /**< Written batches kept for reuse. */
+	pthread_mutex_t lock;       /**< Lock guarding the batch lists and the output files. */
+	pthread_cond_t cond;        /**< Signalled whenever batches are written. */
+} TRIMJOB;
+
+
+/** @var typedef struct trimdeque_t TRIMDEQUE
+ *  @brief Double-ended queue of the samples a trimming thread has work for.
+ *  @note The owner takes from the bottom and other threads steal from the top.
+ */
+
+typedef struct trimdeque_t
+{
+	TRIMJOB **task;             /**< Ring of tasks, each naming the sample to read next from. */
+	unsigned int top;           /**< The index of the oldest task. */
+	unsigned int bottom;        /**< The index one past the newest task. */
+} TRIMDEQUE;
+
+
+/** @var typedef struct trimpool_t TRIMPOOL
+ *  @brief Data structure for the threads trimming samples concurrently.
+ */
+
+typedef struct trimpool_t
+{
+	const CMD *cp;              /**< Pointer to command line data structure. */
+	TRIMJOB *job;               /**< The samples, largest first. */
+	unsigned int njobs;         /**< The number of samples. */
+	unsigned int left;          /**< The number of samples not yet finished. */
+	unsigned int nworkers;      /**< The number of trimming threads. */
+	unsigned int nstarted;      /**< The number of trimming threads started so far. */
+	unsigned long inflight;     /**< The most batches of one sample read but not yet written. */
+	unsigned long memo_hits;    /**< The read pairs answered by the alignment caches of finished threads. */
+	unsigned long memo_pairs;   /**< The read pairs looked up in the alignment caches of finished threads. */
+	int wthreads;               /**< The compression threads of each output file. */
+	char mat[25];               /**< The alignment scoring matrix. */
+	TRIMDEQUE *dq;              /**< The task deque of each thread. */
+	bool failed;                /**< Flag set once a task has failed. */
+	pthread_mutex_t lock;       /**< Lock guarding the deques and the counters. */
+	pthread_cond_t cond;        /**< Signalled whenever a task is queued or a sample finishes. */
+} TRIMPOOL;
+
+
 /** @var typedef struct barcode_t BARCODE
  *  @brief Barcode-level data structure.
  */
@@ -177,8 +504,10 @@ typedef struct barcode_t
 {
 	char *smplID;       /**< The sample identifier from the CSV database file. */
 	char *outfile;      /**< The full path to the output file associated with a biological sample. */
-	char *buffer;       /**< The output buffer associated with a biological sample. */
-	size_t curr_bytes;  /**< The number of bytes currently in the output buffer associated with a biological sample. */
+	char *buffer[2];    /**< The forward and reverse output buffers associated with a biological sample. */
+	size_t curr_bytes[2]; /**< The number of bytes currently in each output buffer. */
+	int fd[2];          /**< Descriptors of the open output files while asynchronous writes are in flight or -1. */
+	off_t offset[2];    /**< The file offsets of the next blocks written to the open output files. */
 } BARCODE;
 
 /** @def KHASH_MAP_INIT_STR(barcode, BARCODE*)
@@ -217,6 +546,41 @@ KHASH_MAP_INIT_STR(pool_hash, khash_t(pool)*)
 
 KHASH_MAP_INIT_STR(fastq, FASTQ*)
 
+/** @var typedef struct sortrec_t SORTREC
+ *  @brief Sort key of a fastQ entry in an external sort run.
+ */
+
+typedef struct sortrec_t
+{
+	uint64_t coord;     /**< The lane, tile and cluster coordinates of the read packed for fast comparison. */
+	const char *key;    /**< The mate pair key of the entry, which breaks ties between packed coordinates. */
+	size_t klen;        /**< The length of the mate pair key. */
+	const FASTQ *e;     /**< The entry held in memory or NULL if it is read from a run. */
+} SORTREC;
+
+/** @var typedef struct runset_t RUNSET
+ *  @brief Data structure for merging the sorted runs of one mate file.
+ */
+
+typedef struct runset_t
+{
+	READER **run;       /**< The readers of the sorted run files. */
+	FQREC *rec;         /**< The current entry of each run. */
+	SORTREC *head;      /**< The sort key of the current entry of each run; the key is NULL once a run has ended. */
+	size_t n;           /**< The number of runs. */
+	FILE *lf;           /**< Pointer to the log file output stream. */
+} RUNSET;
+
+/** @var typedef struct pairdb_t PAIRDB
+ *  @brief Data structure to hold the forward entries of a pair of fastQ files.
+ */
+
+typedef struct pairdb_t
+{
+	khash_t(fastq) *h;  /**< Hash of the forward entries; keys and entries are held in the arena. */
+	ARENA *arena;       /**< The arena holding the forward entries. */
+} PAIRDB;
+
 /** @def KHASH_MAP_INIT_STR(mates, char*)
  *  @brief Defines the hash to hold mate information
  */
@@ -245,64 +609,141 @@ KHASH_MAP_INIT_STR(mates, char*)
 extern int parse_fastq(const CMD *cp, const int orient, const char *filename, khash_t(pool_hash) *h, khash_t(mates) *m);
 
 
-/** @fn int parse_forwardbuffer(const CMD *cp, char *buff, const size_t nl, khash_t(pool_hash) *h, khash_t(mates) *m)
- *  @brief Parses forward fastQ entries in the buffer.
+/** @fn int parse_streams(const CMD *cp, const char *ffor, const char *frev, khash_t(pool_hash) *h)
+ *  @brief Parses forward and reverse input streams in lockstep.
+ *  @details Mates are demultiplexed as they arrive, so the inputs may be pipes.
+ *  @param cp Pointer to command line data structure (read-only).
+ *  @param ffor Pointer to string holding the forward input file name (read-only).
+ *  @param frev Pointer to string holding the reverse input file name or NULL if the
+ *  forward input interleaves both mates (read-only).
+ *  @param h Pointer to pool_hash hash table with parsing database.
+ *  @return Zero on success and non-zero on failure.
+ */
+
+extern int parse_streams(const CMD *cp, const char *ffor, const char *frev, khash_t(pool_hash) *h);
+
+
+/** @fn int parse_forward(const CMD *cp, const FQREC *rec, const khash_t(pool_hash) *h, khash_t(mates) *m)
+ *  @brief Parses a forward fastQ entry into the buffer of its sample.
  *  @param cp Pointer to command line data structure (read-only).
- *  @param buff Pointer to string holding the buffer.
- *  @param nl Number of lines in the buffer (read-only).
+ *  @param rec Pointer to the fastQ entry (read-only).
  *  @param h Pointer to pool_hash hash table with parsing database (read-only).
  *  @param m Pointer to mate information hash table.
  *  @return Zero on success and non-zero on failure.
  */
 
-extern int parse_forwardbuffer(const CMD *cp, char *buff, const size_t nl, const khash_t(pool_hash) *h, khash_t(mates) *m);
+extern int parse_forward(const CMD *cp, const FQREC *rec, const khash_t(pool_hash) *h, khash_t(mates) *m);
 
 
-/** @fn int parse_reversebuffer(const CMD *cp, char *buff, const size_t nl, khash_t(pool_hash) *h, khash_t(mates) *m)
- *  @brief Parses reverse fastQ entries in the buffer.
+/** @fn int parse_reverse(const CMD *cp, const FQREC *rec, const khash_t(pool_hash) *h, const khash_t(mates) *m)
+ *  @brief Parses a reverse fastQ entry into the buffer of its mate's sample.
  *  @param cp Pointer to command line data structure (read-only).
- *  @param buff Pointer to string holding the buffer.
- *  @param nl Number of lines in the buffer (read-only).
+ *  @param rec Pointer to the fastQ entry (read-only).
  *  @param h Pointer to pool_hash hash table with parsing database (read-only).
  *  @param m Pointer to mate information hash table (read-only).
  *  @return Zero on success and non-zero on failure.
  */
 
-extern int parse_reversebuffer(const CMD *cp, char *buff, const size_t nl, const khash_t(pool_hash) *h, const khash_t(mates) *m);
+extern int parse_reverse(const CMD *cp, const FQREC *rec, const khash_t(pool_hash) *h, const khash_t(mates) *m);
 
 
 /******************************************************
  * Sequence pairing functions
  ******************************************************/
 
-/** @fn int pair_mates(const char *filename, const khash_t(fastq) *h, const char *ffor, const char *frev, FILE *lf)
+/** @fn int pair_mates(const CMD *cp, const char *fin, const char *rin, const char *ffor, const char *frev, int nthreads)
  *  @brief Pairs mates in two fastQ files.
- *  @param filename Pointer to string for input forward fastQ (read-only).
- *  @param h Pointer to hash table to hold forward sequences (read only).
+ *  @param cp Pointer to command line data structure (read-only).
+ *  @param fin Pointer to string for input forward fastQ (read-only).
+ *  @param rin Pointer to string for input reverse fastQ (read-only).
  *  @param ffor Pointer to string with forward output file name (read only).
  *  @param frev Pointer to string with reverse output file name (read only).
+ *  @param nthreads Number of compression threads for each output file.
+ *  @return Zero on success and non-zero on failure.
+ */
+
+extern int pair_mates(const CMD *cp, const char *fin, const char *rin, const char *ffor,
+                      const char *frev, int nthreads);
+
+
+/** @fn int pair_sorted(const CMD *cp, PAIRDB *db, READER *fr, READER *rr, const FQREC *rrec, WRITER *fout, WRITER *rout, const char *ffor)
+ *  @brief Pairs the remaining mates of two fastQ files by an external sort-merge.
+ *  @param cp Pointer to command line data structure (read-only).
+ *  @param db Pointer to database holding the forward entries read so far.
+ *  @param fr Pointer to the reader of the forward fastQ file.
+ *  @param rr Pointer to the reader of the reverse fastQ file.
+ *  @param rrec Pointer to the reverse entry that is yet to be paired (read-only).
+ *  @param fout Pointer to the forward output file.
+ *  @param rout Pointer to the reverse output file.
+ *  @param ffor Pointer to string with forward output file name, next to which sort runs are written (read-only).
+ *  @return Zero on success and non-zero on failure.
+ */
+
+extern int pair_sorted(const CMD *cp, PAIRDB *db, READER *fr, READER *rr, const FQREC *rrec,
+                       WRITER *fout, WRITER *rout, const char *ffor);
+
+
+/** @fn int mate_key(const FQREC *rec, const char **key, size_t *klen, FILE *lf)
+ *  @brief Finds the mate pair key in the identifier line of a fastQ entry.
+ *  @param rec Pointer to the fastQ entry (read-only).
+ *  @param key Pointer to the start of the key, which is not NUL-terminated.
+ *  @param klen Pointer to the length of the key.
  *  @param lf Pointer to log file stream.
  *  @return Zero on success and non-zero on failure.
  */
 
-extern int pair_mates(const char *filename, const khash_t(fastq) *h, const char *ffor, const char *frev, FILE *lf);
+extern int mate_key(const FQREC *rec, const char **key, size_t *klen, FILE *lf);
+
+
+/** @fn int write_pair(WRITER *fout, WRITER *rout, const FASTQ *e, const FQREC *f, const FQREC *r, FILE *lf)
+ *  @brief Writes a pair of mates to the forward and reverse output files.
+ *  @param fout Pointer to the forward output file.
+ *  @param rout Pointer to the reverse output file.
+ *  @param e Pointer to the held forward entry or NULL to write f (read-only).
+ *  @param f Pointer to the forward entry if e is NULL (read-only).
+ *  @param r Pointer to the reverse entry (read-only).
+ *  @param lf Pointer to log file stream.
+ *  @return Zero on success and non-zero on failure.
+ */
+
+extern int write_pair(WRITER *fout, WRITER *rout, const FASTQ *e, const FQREC *f, const FQREC *r,
+                      FILE *lf);
+
+
+/******************************************************
+ * Part file merging functions
+ ******************************************************/
+
+/** @fn int merge_parts(const char *outfile, char **parts, const unsigned int nparts, FILE *lf)
+ *  @brief Concatenates compressed part files into one output file.
+ *  @param outfile Pointer to string with merged output file name (read-only).
+ *  @param parts Pointer to array of part file names.
+ *  @param nparts Number of part files to merge (read-only).
+ *  @param lf Pointer to log file stream.
+ *  @return Zero on success and non-zero on failure.
+ */
+
+extern int merge_parts(const char *outfile, char **parts, const unsigned int nparts, FILE *lf);
 
 
 /******************************************************
  * Trimend functions
  ******************************************************/
 
-/** @fn int align_mates(const CMD *cp, const char *fin, const char *rin, const char *fout, const char *rout)
- *  @brief Align mates in two fastQ files and trim 3' end of reverse sequences.
+/** @fn int align_mates(const CMD *cp, const char *mat, ALIGN_CTX *ctx, const FQREC *frec, FQREC *rrec, size_t n, unsigned int *count)
+ *  @brief Align the mates of a batch of pairs and trim 3' end of the reverse sequences.
  *  @param cp Pointer to command line data structure (read-only).
- *  @param fin Pointer to string with forward input file name (read-only).
- *  @param rin Pointer to string with reverse input file name (read-only).
- *  @param fout Pointer to string with forward output file name (read-only).
- *  @param rout Pointer to string with reverse output file name (read-only).
+ *  @param mat Pointer to the alignment scoring matrix (read-only).
+ *  @param ctx Pointer to the alignment buffers of the calling thread.
+ *  @param frec Pointer to the array of forward entries (read-only).
+ *  @param rrec Pointer to the array of reverse entries, whose lengths are trimmed.
+ *  @param n Number of pairs in the arrays.
+ *  @param count Pointer to the count of trimmed sequences, incremented on a trim.
  *  @return Zero on success and non-zero on failure.
  */
 
-extern int align_mates(const CMD *cp, const char *fin, const char *rin, const char *fout, const char *rout);
+extern int align_mates(const CMD *cp, const char *mat, ALIGN_CTX *ctx, const FQREC *frec, FQREC *rrec,
+                       size_t n, unsigned int *count);
 
 
 /******************************************************
@@ -341,14 +782,14 @@ extern khash_t(pool_hash) *read_csv(const CMD *cp);
 extern int check_csv(const CMD *cp);
 
 
-/** @fn khash_t(fastq)* fastq_to_db(const char *filename, FILE *lf)
- *  @brief Populates a fastQ database from fastQ input file.
- *  @param filename Pointer to string holding input fastQ file name (read-only).
- *  @param lf Pointer to log file stream.
- *  @return Pointer to fastQ hash table on success or NULL on failure.
+/** @fn void prefetch(const CMD *cp, char **files, unsigned int n)
+ *  @brief Starts reading the next input files into the page cache.
+ *  @param cp Pointer to command line data structure (read-only).
+ *  @param files Array of the input file names in the order they will be read.
+ *  @param n Number of input file names in the array.
  */
 
-extern khash_t(fastq) *fastq_to_db(const char *filename, FILE *lf);
+extern void prefetch(const CMD *cp, char **files, unsigned int n);
 
 
 /******************************************************
@@ -376,48 +817,360 @@ extern int create_dirtree(const CMD *cp, const khash_t(pool_hash) *h);
 extern unsigned int traverse_dirtree(const CMD *cp, const char *caller, char ***flist);
 
 
+/** @fn int link_file(const char *src, const char *dst, FILE *lf)
+ *  @brief Puts an unchanged copy of a file at a new path, sharing its data where the file system allows.
+ *  @param src Pointer to string holding the existing file name (read-only).
+ *  @param dst Pointer to string holding the new file name, replaced if it exists (read-only).
+ *  @param lf Pointer to log file stream.
+ *  @return Zero on success and non-zero on failure.
+ */
+
+extern int link_file(const char *src, const char *dst, FILE *lf);
+
+
 /******************************************************
  * Buffer management functions
  ******************************************************/
 
-/** @fn char *clean_buffer(char *buff, size_t *nl)
- *  @brief Limits the buffer to hold only entire fastQ entries.
- *  @param buff Pointer to the string holding the buffer.
- *  @param nl Number of new line characters in the buffer.
- *  @return Pointer to new end of buffer.
+/** @fn int buffer_record(const CMD *cp, int orient, BARCODE *bc, const FQREC *rec, size_t trim)
+ *  @brief Appends a fastQ entry to a sample buffer, flushing the buffer when full.
+ *  @param cp Pointer to command line data structure (read-only).
+ *  @param orient Flag indicating whether the entry is a forward or reverse read.
+ *  @param bc Pointer to the BARCODE data structure of the sample.
+ *  @param rec Pointer to the fastQ entry (read-only).
+ *  @param trim Number of leading bases to trim from the sequence and quality lines.
+ *  @return Zero on success and non-zero on failure.
+ */
+
+extern int buffer_record(const CMD *cp, int orient, BARCODE *bc, const FQREC *rec, size_t trim);
+
+
+/** @fn int flush_buffer(const CMD *cp, int orient, BARCODE *bc)
+ *  @brief Dumps a full buffer to file.
+ *  @param cp Pointer to command line data structure (read-only).
+ *  @param orient Orientation of reads in the buffer.
+ *  @param bc Pointer to BARCODE data structure.
+ *  @return Zero on success and non-zero on failure.
+ */
+
+extern int flush_buffer(const CMD *cp, int orient, BARCODE *bc);
+
+
+/** @fn int flush_pools(const CMD *cp, int orient, const khash_t(pool_hash) *h)
+ *  @brief Dumps the remaining output buffers of all samples to file.
+ *  @param cp Pointer to command line data structure (read-only).
+ *  @param orient Orientation of reads in the buffers.
+ *  @param h Pointer to pool_hash hash table with parsing database (read-only).
+ *  @return Zero on success and non-zero on failure.
  */
 
-extern char *clean_buffer(char *buff, size_t *nl);
+extern int flush_pools(const CMD *cp, int orient, const khash_t(pool_hash) *h);
 
 
-/** @fn size_t reset_buffer(char *buff, const char *r)
- *  @brief Resets the buffer for next read block.
- *  @param buff Pointer to the string holding the buffer.
- *  @param r Pointer to new end of buffer (read-only).
- *  @return The number of leftover characters in the old buffer.
+/** @fn int write_block(int fd, off_t *offset, const char *data, size_t len, int level, int format, FILE *lf)
+ *  @brief Compresses a block of data and writes it at a file offset.
+ *  @param fd Output file descriptor.
+ *  @param offset Pointer to the file offset, advanced past the written block.
+ *  @param data Pointer to the uncompressed data (read-only).
+ *  @param len Number of bytes of uncompressed data.
+ *  @param level Compression level.
+ *  @param format Compression format (GZIP_FORMAT or ZSTD_FORMAT).
+ *  @param lf Pointer to log file stream.
+ *  @return Zero on success and non-zero on failure.
  */
 
-extern size_t reset_buffer(char *buff, const char *r);
+extern int write_block(int fd, off_t *offset, const char *data, size_t len, int level, int format,
+                       FILE *lf);
 
 
-/** @fn size_t reset_buffer(char *buff, const char *r)
- *  @brief Counts newline characters in buffer.
- *  @param buff Pointer to the string holding the buffer (read-only).
- *  @return The number of newline characters in the buffer.
+/** @fn void write_block_free(void)
+ *  @brief Releases the scratch space kept by the calling thread.
  */
 
-extern size_t count_lines(const char *buff);
+extern void write_block_free(void);
 
 
-/** @fn int flush_buffer(int orient, BARCODE *bc)
- *  @brief Dumps a full buffer to file.
- *  @param orient Orientation of reads in the buffer.
- *  @param bc Pointer to BARCODE data structure.
+/** @fn int write_data(int fd, off_t *offset, const char *data, size_t len, FILE *lf)
+ *  @brief Writes already compressed data at a file offset.
+ *  @param fd Output file descriptor.
+ *  @param offset Pointer to the file offset, advanced past the written data.
+ *  @param data Pointer to the data (read-only).
+ *  @param len Number of bytes of data.
  *  @param lf Pointer to log file stream.
  *  @return Zero on success and non-zero on failure.
  */
 
-extern int flush_buffer(int orient, BARCODE *bc, FILE *lf);
+extern int write_data(int fd, off_t *offset, const char *data, size_t len, FILE *lf);
+
+
+/******************************************************
+ * Output stream functions
+ ******************************************************/
+
+/** @fn WRITER *writer_open(const char *filename, int level, int nthreads, FILE *lf)
+ *  @brief Opens a compressed output file for writing.
+ *  @details Files ending in ".zst" are Zstandard-compressed, all others gzip-compressed.
+ *  @param filename Pointer to string holding output file name (read-only).
+ *  @param level Compression level of the output file.
+ *  @param nthreads Number of Zstandard compression threads.
+ *  @param lf Pointer to log file stream.
+ *  @return Pointer to WRITER data structure on success or NULL on failure.
+ */
+
+extern WRITER *writer_open(const char *filename, int level, int nthreads, FILE *lf);
+
+
+/** @fn int writer_printf(WRITER *w, const char *format, ...)
+ *  @brief Writes a formatted entry to a compressed output file.
+ *  @param w Pointer to WRITER data structure.
+ *  @param format Pointer to format string (read-only).
+ *  @return Zero on success and non-zero on failure.
+ */
+
+extern int writer_printf(WRITER *w, const char *format, ...);
+
+
+/** @fn long writer_pack(const WRITER *w, const char *in, size_t len, char *out, size_t cap)
+ *  @brief Compresses a block for an output file without touching the file.
+ *  @details Any thread may call this while another writes to the file.
+ *  @param w Pointer to WRITER data structure (read-only).
+ *  @param in Pointer to the uncompressed block (read-only).
+ *  @param len Length of the uncompressed block.
+ *  @param out Pointer to the output buffer of at least compress_bound(len) bytes.
+ *  @param cap Capacity of the output buffer.
+ *  @return Size of the compressed block on success or -1 on failure.
+ */
+
+extern long writer_pack(const WRITER *w, const char *in, size_t len, char *out, size_t cap);
+
+
+/** @fn int writer_append(WRITER *w, const char *data, size_t len)
+ *  @brief Writes blocks compressed by writer_pack to an output file.
+ *  @param w Pointer to WRITER data structure.
+ *  @param data Pointer to the compressed blocks (read-only).
+ *  @param len Length of the compressed blocks.
+ *  @return Zero on success and non-zero on failure.
+ */
+
+extern int writer_append(WRITER *w, const char *data, size_t len);
+
+
+/** @fn int writer_close(WRITER *w)
+ *  @brief Writes out buffered data and closes a compressed output file.
+ *  @param w Pointer to WRITER data structure.
+ *  @return Zero on success and non-zero on failure.
+ */
+
+extern int writer_close(WRITER *w);
+
+
+/******************************************************
+ * Input stream functions
+ ******************************************************/
+
+/** @fn INSTREAM *instream_open(const char *filename, FILE *lf)
+ *  @brief Opens a gzip, Zstandard or uncompressed input file for reading.
+ *  @param filename Pointer to string holding input file name (read-only).
+ *  @param lf Pointer to log file stream.
+ *  @return Pointer to INSTREAM data structure on success or NULL on failure.
+ */
+
+extern INSTREAM *instream_open(const char *filename, FILE *lf);
+
+
+/** @fn INSTREAM *instream_fdopen(int fd, const char *filename, FILE *lf)
+ *  @brief Opens a compressed input stream on an open file descriptor.
+ *  @param fd Input file descriptor, which is closed with the stream.
+ *  @param filename Pointer to string holding input file name for messages (read-only).
+ *  @param lf Pointer to log file stream.
+ *  @return Pointer to INSTREAM data structure on success or NULL on failure.
+ */
+
+extern INSTREAM *instream_fdopen(int fd, const char *filename, FILE *lf);
+
+
+/** @fn long instream_read(INSTREAM *s, char *buf, size_t len)
+ *  @brief Reads decompressed data from an input file.
+ *  @param s Pointer to INSTREAM data structure.
+ *  @param buf Pointer to the destination buffer.
+ *  @param len Maximum number of bytes to read.
+ *  @return Number of bytes read, zero at the end of the file or -1 on failure.
+ */
+
+extern long instream_read(INSTREAM *s, char *buf, size_t len);
+
+
+/** @fn long instream_getline(INSTREAM *s, char **line, size_t *cap)
+ *  @brief Reads a line of any length from an input file.
+ *  @details The line buffer is allocated or grown as needed and can be reused
+ *  between calls, like the buffer of getline(3).
+ *  @param s Pointer to INSTREAM data structure.
+ *  @param line Pointer to the line buffer pointer.
+ *  @param cap Pointer to the capacity of the line buffer.
+ *  @return Length of the line, zero at the end of the file or -1 on failure.
+ */
+
+extern long instream_getline(INSTREAM *s, char **line, size_t *cap);
+
+
+/** @fn bool instream_eof(INSTREAM *s)
+ *  @brief Checks whether the end of an input file was reached.
+ *  @param s Pointer to INSTREAM data structure.
+ *  @return True at the end of the file and false otherwise.
+ */
+
+extern bool instream_eof(INSTREAM *s);
+
+
+/** @fn void instream_close(INSTREAM *s)
+ *  @brief Closes an input file.
+ *  @param s Pointer to INSTREAM data structure.
+ */
+
+extern void instream_close(INSTREAM *s);
+
+
+/******************************************************
+ * Record input functions
+ ******************************************************/
+
+/** @fn READER *reader_open(const char *filename, FILE *lf)
+ *  @brief Opens a fastQ file for reading records.
+ *  @details Uncompressed files are memory-mapped and read in place.
+ *  @param filename Pointer to string holding input file name (read-only).
+ *  @param lf Pointer to log file stream.
+ *  @return Pointer to READER data structure on success or NULL on failure.
+ */
+
+extern READER *reader_open(const char *filename, FILE *lf);
+
+
+/** @fn int reader_next(READER *r, FQREC *rec)
+ *  @brief Reads the next fastQ record.
+ *  @details The record fields point into the reader's buffer and stay valid
+ *  until the next call.
+ *  @param r Pointer to READER data structure.
+ *  @param rec Pointer to FQREC data structure to receive the record.
+ *  @return One if a record was read, zero at the end of the file and -1 on failure.
+ */
+
+extern int reader_next(READER *r, FQREC *rec);
+
+
+/** @fn void reader_close(READER *r)
+ *  @brief Closes a fastQ record reader.
+ *  @param r Pointer to READER data structure.
+ */
+
+extern void reader_close(READER *r);
+
+
+/******************************************************
+ * Compression functions
+ ******************************************************/
+
+/** @fn size_t compress_bound(size_t len, int format)
+ *  @brief Upper bound on the compressed size of a block.
+ *  @param len Number of bytes of uncompressed data.
+ *  @param format Compression format (GZIP_FORMAT or ZSTD_FORMAT).
+ *  @return Maximum number of bytes of the compressed block.
+ */
+
+extern size_t compress_bound(size_t len, int format);
+
+
+/** @fn long compress_buffer(const char *in, size_t len, char *out, size_t cap, int level, int format)
+ *  @brief Compresses a block of data into a self-contained gzip member or Zstandard frame.
+ *  @param in Pointer to the uncompressed data (read-only).
+ *  @param len Number of bytes of uncompressed data.
+ *  @param out Pointer to the output buffer.
+ *  @param cap Capacity of the output buffer.
+ *  @param level Compression level.
+ *  @param format Compression format (GZIP_FORMAT or ZSTD_FORMAT).
+ *  @return Number of compressed bytes on success or -1 on failure.
+ */
+
+extern long compress_buffer(const char *in, size_t len, char *out, size_t cap, int level, int format);
+
+
+/** @fn void compress_free(void)
+ *  @brief Releases the compression state kept by the calling thread.
+ */
+
+extern void compress_free(void);
+
+
+/******************************************************
+ * Asynchronous write functions
+ ******************************************************/
+
+/** @fn int aio_init(unsigned int depth, FILE *lf)
+ *  @brief Sets up an io_uring for asynchronous output writes.
+ *  @param depth Maximum number of writes in flight.
+ *  @param lf Pointer to log file stream.
+ *  @return Zero on success and non-zero if writes stay synchronous.
+ */
+
+extern int aio_init(unsigned int depth, FILE *lf);
+
+
+/** @fn bool aio_enabled(void)
+ *  @brief Tests whether output writes are asynchronous.
+ *  @return True if asynchronous writes are set up.
+ */
+
+extern bool aio_enabled(void);
+
+
+/** @fn size_t aio_buflen(void)
+ *  @brief Capacity of each asynchronous write buffer.
+ *  @return Number of bytes in each write buffer.
+ */
+
+extern size_t aio_buflen(void);
+
+
+/** @fn char *aio_buffer(void)
+ *  @brief Takes a free write buffer, waiting for a completion only if all are in flight.
+ *  @return Pointer to the write buffer on success or NULL on failure.
+ */
+
+extern char *aio_buffer(void);
+
+
+/** @fn void aio_release(char *buf)
+ *  @brief Returns a buffer taken with aio_buffer() that will not be submitted.
+ *  @param buf Pointer to the write buffer.
+ */
+
+extern void aio_release(char *buf);
+
+
+/** @fn int aio_submit(int fd, char *buf, size_t len, off_t offset)
+ *  @brief Queues a write of a buffer taken with aio_buffer().
+ *  @param fd Output file descriptor, which must stay open until aio_drain().
+ *  @param buf Pointer to the write buffer.
+ *  @param len Number of bytes to write.
+ *  @param offset File offset of the write.
+ *  @return Zero on success and non-zero on failure, when the buffer is returned to the ring.
+ */
+
+extern int aio_submit(int fd, char *buf, size_t len, off_t offset);
+
+
+/** @fn int aio_drain(void)
+ *  @brief Waits for all writes in flight, from any thread, to complete.
+ *  @return Zero if all writes succeeded and non-zero otherwise.
+ */
+
+extern int aio_drain(void);
+
+
+/** @fn void aio_destroy(void)
+ *  @brief Waits for outstanding writes and tears down the io_uring.
+ */
+
+extern void aio_destroy(void);
 
 
 /******************************************************
@@ -442,13 +1195,69 @@ extern int destroy_cmdline(CMD *cp);
 extern int free_db(khash_t(pool_hash) *h);
 
 
-/** @fn int free_pairdb (khash_t(fastq) *h)
+/** @fn PAIRDB *init_pairdb(FILE *lf)
+ *  @brief Creates an empty forward fastQ database.
+ *  @param lf Pointer to log file stream.
+ *  @return Pointer to fastQ database on success or NULL on failure.
+ */
+
+extern PAIRDB *init_pairdb(FILE *lf);
+
+
+/** @fn int add_pairdb(PAIRDB *db, const FQREC *rec, const char *key, size_t klen)
+ *  @brief Copies a forward fastQ entry into the forward fastQ database.
+ *  @param db Pointer to database holding forward sequences.
+ *  @param rec Pointer to the fastQ entry (read-only).
+ *  @param key Pointer to the mate pair key of the entry, which need not be NUL-terminated (read-only).
+ *  @param klen Length of the mate pair key.
+ *  @return Zero on success and non-zero on failure.
+ */
+
+extern int add_pairdb(PAIRDB *db, const FQREC *rec, const char *key, size_t klen);
+
+
+/** @fn int free_pairdb(PAIRDB *db)
  *  @brief Deallocates memory used by forward fastQ database.
- *  @param h Pointer to hash table to hold forward sequences.0
+ *  @param db Pointer to database holding forward sequences.
  *  @return Zero on success and non-zero on failure.
  */
 
-extern int free_pairdb(khash_t(fastq) *h);
+extern int free_pairdb(PAIRDB *db);
+
+
+/** @fn ARENA *arena_create(FILE *lf)
+ *  @brief Creates an empty record arena.
+ *  @param lf Pointer to log file stream.
+ *  @return Pointer to the arena on success or NULL on failure.
+ */
+
+extern ARENA *arena_create(FILE *lf);
+
+
+/** @fn void *arena_alloc(ARENA *a, size_t n)
+ *  @brief Allocates memory from a record arena.
+ *  @param a Pointer to the arena.
+ *  @param n Number of bytes to allocate.
+ *  @return Pointer to pointer-aligned memory on success or NULL on failure.
+ */
+
+extern void *arena_alloc(ARENA *a, size_t n);
+
+
+/** @fn void arena_reset(ARENA *a)
+ *  @brief Releases everything allocated from a record arena but keeps it for reuse.
+ *  @param a Pointer to the arena.
+ */
+
+extern void arena_reset(ARENA *a);
+
+
+/** @fn void arena_destroy(ARENA *a)
+ *  @brief Releases a record arena and everything allocated from it.
+ *  @param a Pointer to the arena or NULL.
+ */
+
+extern void arena_destroy(ARENA *a);
 
 
 /** @fn int free_matedb(khash_t(mates) *m)
@@ -464,8 +1273,144 @@ extern int free_matedb(khash_t(mates) *m);
  * Alignment functions
  ******************************************************/
 
-/** @fn ALIGN_RESULT local_align(int qlen, char *query, int tlen, char *target, const char *mat, int gapo, int gape, int xtra, FILE *lf)
+/** @fn ALIGN_CTX *align_ctx_create(FILE *lf)
+ *  @brief Creates the reusable alignment buffers of one thread.
+ *  @param lf Pointer to log file stream.
+ *  @return Pointer to ALIGN_CTX data structure on success or NULL on failure.
+ */
+
+extern ALIGN_CTX *align_ctx_create(FILE *lf);
+
+
+/** @fn int align_ctx_reserve(ALIGN_CTX *ctx, int qlen, int tlen)
+ *  @brief Grows the alignment buffers to fit a query and a target sequence.
+ *  @param ctx Pointer to ALIGN_CTX data structure.
+ *  @param qlen Length of the query sequence.
+ *  @param tlen Length of the target sequence.
+ *  @return Zero on success and non-zero on failure.
+ */
+
+extern int align_ctx_reserve(ALIGN_CTX *ctx, int qlen, int tlen);
+
+
+/** @fn int align_ctx_reserve_batch(ALIGN_CTX *ctx, int len)
+ *  @brief Grows the transposed buffers of the batch kernel to fit sequences of a length.
+ *  @param ctx Pointer to ALIGN_CTX data structure.
+ *  @param len Length of the longest sequence in the batch.
+ *  @return Zero on success and non-zero on failure.
+ */
+
+extern int align_ctx_reserve_batch(ALIGN_CTX *ctx, int len);
+
+
+/** @fn int align_ctx_reserve_band(ALIGN_CTX *ctx, int band)
+ *  @brief Grows the score rows of the banded overlap alignment to fit a band.
+ *  @param ctx Pointer to ALIGN_CTX data structure.
+ *  @param band Number of diagonals either side of the overlap.
+ *  @return Zero on success and non-zero on failure.
+ */
+
+extern int align_ctx_reserve_band(ALIGN_CTX *ctx, int band);
+
+
+/** @fn void align_ctx_destroy(ALIGN_CTX *ctx)
+ *  @brief Frees the alignment buffers of one thread.
+ *  @param ctx Pointer to ALIGN_CTX data structure.
+ */
+
+extern void align_ctx_destroy(ALIGN_CTX *ctx);
+
+
+/** @fn const ALIGN_KERNEL *align_kernel(void)
+ *  @brief Chooses the widest Smith-Waterman kernels the processor supports.
+ *  @return Pointer to the ALIGN_KERNEL data structure of the kernels.
+ */
+
+extern const ALIGN_KERNEL *align_kernel(void);
+
+
+/** @fn ALIGN_QUERY *align_init_sse2(ALIGN_CTX *ctx, int qlen, const char *query, const char *mat, int size)
+ *  @brief Builds the striped query profile for 128-bit SSE2 vectors.
+ *  @param ctx Pointer to ALIGN_CTX data structure reserved for the query length.
+ *  @param qlen Length of the query sequence.
+ *  @param query Pointer to the encoded query sequence (read-only).
+ *  @param mat Scoring matrix in a one-dimension array (read-only).
+ *  @param size Size of the score cells in bytes, 1 or 2.
+ *  @return Pointer to the query profile held in the context.
+ *  @note align_init_avx2 and align_init_avx512 do the same for 256-bit and 512-bit vectors.
+ */
+
+extern ALIGN_QUERY *align_init_sse2(ALIGN_CTX *ctx, int qlen, const char *query, const char *mat, int size);
+extern ALIGN_QUERY *align_init_avx2(ALIGN_CTX *ctx, int qlen, const char *query, const char *mat, int size);
+extern ALIGN_QUERY *align_init_avx512(ALIGN_CTX *ctx, int qlen, const char *query, const char *mat, int size);
+
+
+/** @fn ALIGN_RESULT smith_waterman_sse2(ALIGN_CTX *ctx, ALIGN_QUERY *q, int tlen, const char *target, int gapo, int gape, int xtra)
+ *  @brief Striped Smith-Waterman alignment with 8-bit cells in 128-bit SSE2 vectors.
+ *  @param ctx Pointer to ALIGN_CTX data structure reserved for the target length.
+ *  @param q Pointer to the 8-bit query profile.
+ *  @param tlen Length of the target sequence.
+ *  @param target Pointer to the encoded target sequence (read-only).
+ *  @param gapo Gap penalty.
+ *  @param gape Gap extension penalty.
+ *  @param xtra Status variable.
+ *  @return ALIGN_RESULT data structure, with a score of 255 if the cells saturated.
+ *  @note The _avx2 and _avx512 variants use 256-bit and 512-bit vectors, and the
+ *        smith_waterman16 variants 16-bit cells; all return the same result.
+ */
+
+extern ALIGN_RESULT smith_waterman_sse2(ALIGN_CTX *ctx, ALIGN_QUERY *q, int tlen, const char *target, int gapo, int gape, int xtra);
+extern ALIGN_RESULT smith_waterman_avx2(ALIGN_CTX *ctx, ALIGN_QUERY *q, int tlen, const char *target, int gapo, int gape, int xtra);
+extern ALIGN_RESULT smith_waterman_avx512(ALIGN_CTX *ctx, ALIGN_QUERY *q, int tlen, const char *target, int gapo, int gape, int xtra);
+extern ALIGN_RESULT smith_waterman16_sse2(ALIGN_CTX *ctx, ALIGN_QUERY *q, int tlen, const char *target, int gapo, int gape, int xtra);
+extern ALIGN_RESULT smith_waterman16_avx2(ALIGN_CTX *ctx, ALIGN_QUERY *q, int tlen, const char *target, int gapo, int gape, int xtra);
+extern ALIGN_RESULT smith_waterman16_avx512(ALIGN_CTX *ctx, ALIGN_QUERY *q, int tlen, const char *target, int gapo, int gape, int xtra);
+
+
+/** @fn void batch_score_sse2(const void *bq, int qlen, const void *bt, int tlen, void *work, int gapo, int gape, int sa, int sb, unsigned char *score)
+ *  @brief Smith-Waterman scores of 16 independent pairs, one pair per 8-bit lane.
+ *  @param bq Pointer to the encoded queries, transposed so position j of every query is one vector.
+ *  @param qlen Length of the longest query, the shorter ones padded with code 4.
+ *  @param bt Pointer to the encoded targets, transposed in the same way.
+ *  @param tlen Length of the longest target.
+ *  @param work Pointer to aligned scratch space of 2 * qlen vectors.
+ *  @param gapo Gap penalty.
+ *  @param gape Gap extension penalty.
+ *  @param sa Match score.
+ *  @param sb Mismatch penalty; code 4 scores zero against anything.
+ *  @param score Pointer to one best score per lane, 255 if the lane saturated.
+ *  @note The _avx2 and _avx512 variants score 32 and 64 pairs at once.
+ */
+
+extern void batch_score_sse2(const void *bq, int qlen, const void *bt, int tlen, void *work, int gapo, int gape, int sa, int sb, unsigned char *score);
+extern void batch_score_avx2(const void *bq, int qlen, const void *bt, int tlen, void *work, int gapo, int gape, int sa, int sb, unsigned char *score);
+extern void batch_score_avx512(const void *bq, int qlen, const void *bt, int tlen, void *work, int gapo, int gape, int sa, int sb, unsigned char *score);
+
+
+/** @fn ALIGN_RESULT overlap_align(ALIGN_CTX *ctx, int qlen, const char *query, int tlen, const char *target, const char *mat, int gapo, int gape, int band, int minsc)
+ *  @brief Best banded alignment that starts with the first base of the target or of the query.
+ *  @param ctx Pointer to ALIGN_CTX data structure reserved for the band.
+ *  @param qlen Length of query sequence.
+ *  @param query Pointer to the encoded query sequence (read-only).
+ *  @param tlen Length of the target sequence.
+ *  @param target Pointer to the encoded target sequence (read-only).
+ *  @param mat Scoring matrix in a one-dimension array (read-only).
+ *  @param gapo Gap penalty.
+ *  @param gape Gap extension penalty.
+ *  @param band Number of diagonals either side of the starting one that gaps may reach.
+ *  @param minsc Minimum score of interest; lower scoring overlaps are not resolved.
+ *  @return ALIGN_RESULT data structure whose query_begin and target_begin give the overlap
+ *          offset, one of them zero, if an overlap reached the minimum score; both are -1 otherwise.
+ */
+
+extern ALIGN_RESULT overlap_align(ALIGN_CTX *ctx, int qlen, const char *query, int tlen,
+                                  const char *target, const char *mat, int gapo, int gape, int band,
+                                  int minsc);
+
+
+/** @fn ALIGN_RESULT local_align(ALIGN_CTX *ctx, int qlen, char *query, int tlen, char *target, const char *mat, int gapo, int gape, int xtra)
  *  @brief Calculates the local sequence alignment by Smith-Waterman algorithm.
+ *  @param ctx Pointer to ALIGN_CTX data structure reserved for the sequence lengths.
  *  @param qlen Length of query sequence.
  *  @param query Pointer string holding query sequence.
  *  @param tlen Length of the target sequence.
@@ -474,21 +1419,35 @@ extern int free_matedb(khash_t(mates) *m);
  *  @param gapo Gap penalty.
  *  @param gape Gap extension penalty.
  *  @param xtra Status variable.
- *  @param lf Pointer to log file stream.
  *  @return ALIGN_RESULT data structure on success
  */
 
-extern ALIGN_RESULT local_align(int qlen, char *query, int tlen, char *target, const char *mat, int gapo, int gape, int xtra, FILE *lf);
+extern ALIGN_RESULT local_align(ALIGN_CTX *ctx, int qlen, char *query, int tlen, char *target,
+                                const char *mat, int gapo, int gape, int xtra);
 
 
-/** @fn char *revcom(const char *s, FILE *lf)
- *  @brief Reverse complement a DNA string with full IUPAC alphabet.
+/** @fn int revcom_nt4(const char *s, size_t len, char *out, FILE *lf)
+ *  @brief Encodes the reverse complement of a DNA string with full IUPAC alphabet for the aligner.
  *  @param s Pointer to string to be reverse-complemented (read-only).
+ *  @param len Length of the string, which need not be NUL-terminated.
+ *  @param out Pointer to buffer of at least len bytes for the codes, 0 to 3 for A, C, G and T
+ *         and 4 for the other IUPAC codes and gaps.
  *  @param lf Pointer to log file stream.
- *  @return Pointer to newly allocated reverse-complemented string on success or NULL on failure.
+ *  @return Zero on success and non-zero on failure.
+ */
+
+extern int revcom_nt4(const char *s, size_t len, char *out, FILE *lf);
+
+
+/** @fn void encode_nt4(const char *s, size_t len, char *out)
+ *  @brief Encodes a DNA string for the aligner.
+ *  @param s Pointer to string to be encoded (read-only).
+ *  @param len Length of the string, which need not be NUL-terminated.
+ *  @param out Pointer to buffer of at least len bytes for the codes, 0 to 3 for A, C, G and T
+ *         and 4 for anything else.
  */
 
-extern char *revcom(const char *s, FILE *lf);
+extern void encode_nt4(const char *s, size_t len, char *out);
 
 
 /******************************************************
@@ -19,6 +19,11 @@ int destroy_cmdline(CMD *cp)
 	free(cp->mode);
 	free(cp->glob);
 	free(cp->csvfile);
+	free(cp->part);
+	free(cp->r1);
+	free(cp->r2);
+	free(cp->flowcell);
+	free(cp->lane);
 	free(cp);
 	return 0;
 }
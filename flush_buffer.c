@@ -11,108 +11,93 @@
 #include <string.h>
 #include <fcntl.h>
 #include <unistd.h>
-#include <zlib.h>
 #include <errno.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include "khash.h"
 #include "ddradseq.h"
 
-#define MAX_ATTEMPTS 100
-
 extern int errno;
 
-int flush_buffer(int orient, BARCODE *bc, FILE *lf)
+int flush_buffer(const CMD *cp, int orient, BARCODE *bc)
 {
-	char *filename = strdup(bc->outfile);
-	char *buffer = bc->buffer;
+	char *filename = NULL;
 	char *pch = NULL;
 	char *errstr = NULL;
 	int ret = 0;
-	int fd;
-	int num_attempts = 0;
-	size_t len = bc->curr_bytes;
 	struct flock fl = {F_WRLCK, SEEK_SET, 0, 0, 0};
-	struct flock fl2;
 	mode_t mode;
-	gzFile gzf;
-
-	fl.l_pid = getpid();
-	memset(&fl2, 0, sizeof(struct flock));
-
-	/* Set permissions if new output file needs to be created */
-	mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH;
+	FILE *lf = cp->lf;
 
-	/* Convert forward output file name to reverse */
-	if (orient == REVERSE)
+	/* The output file stays open between flushes */
+	/* while asynchronous writes are in flight */
+	if (bc->fd[orient] < 0)
 	{
-		pch = strstr(filename, ".R1.fq.gz");
-		strncpy(pch, ".R2", 3);
-	}
+		filename = strdup(bc->outfile);
+		if (UNLIKELY(!filename))
+		{
+			logerror(lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
+			return 1;
+		}
 
-	/* Get output file descriptor */
-	fd = open(filename, O_WRONLY | O_CREAT | O_APPEND, mode);
-	if (fd < 0)
-	{
-		errstr = strerror(errno);
-		logerror(lf, "%s:%d Unable to open output file \'%s\': %s.\n", __func__,
-		         __LINE__, filename, errstr);
-		return 1;
-	}
+		/* Set permissions if new output file needs to be created */
+		mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH;
 
-	/* Test if output file has lock in 30 second intervals */
-	/* Will timeout after MAX_ATTEMPTS attempts to get a lock */
-	fcntl(fd, F_GETLK, &fl2);
-	num_attempts++;
-	while (fl2.l_type != F_UNLCK)
-	{
-		if (num_attempts > MAX_ATTEMPTS)
+		/* Convert forward output file name to reverse */
+		if (orient == REVERSE)
 		{
-			logerror(lf, "%s:%d File \'%s\' is still locked after %d attempts... exiting.\n", __func__,
-			         __LINE__, filename, num_attempts);
+			pch = strstr(filename, cp->part ? ".R1.part-" : ".R1.fq.");
+			strncpy(pch, ".R2", 3);
+		}
+
+		/* Get output file descriptor */
+		bc->fd[orient] = open(filename, O_WRONLY | O_CREAT, mode);
+		if (bc->fd[orient] < 0)
+		{
+			errstr = strerror(errno);
+			logerror(lf, "%s:%d Unable to open output file \'%s\': %s.\n", __func__,
+			         __LINE__, filename, errstr);
+			free(filename);
 			return 1;
 		}
-		else
+
+		/* Part files belong to this process alone and need no lock */
+		/* Otherwise block until any other writer releases the file */
+		fl.l_pid = getpid();
+		if (!cp->part && fcntl(bc->fd[orient], F_SETLKW, &fl) == -1)
 		{
-			sleep(30);
-			fcntl(fd, F_GETLK, &fl2);
-			num_attempts++;
+			errstr = strerror(errno);
+			logerror(lf, "%s:%d Failed to set lock on file \'%s\': %s.\n", __func__,
+			         __LINE__, filename, errstr);
+			free(filename);
+			return 1;
 		}
+		free(filename);
+
+		/* Append after whatever the file already holds */
+		bc->offset[orient] = lseek(bc->fd[orient], 0, SEEK_END);
 	}
 
-	/* Set lock on output file */
-	if (fcntl(fd, F_SETLKW, &fl) == -1)
+	/* Write the buffer as a gzip member */
+	ret = write_block(bc->fd[orient], &bc->offset[orient], bc->buffer[orient],
+	                  bc->curr_bytes[orient], cp->parse_level, cp->format, lf);
+	if (ret)
 	{
-		errstr = strerror(errno);
-		logerror(lf, "%s:%d Failed to set lock on file \'%s\': %s.\n", __func__,
-		         __LINE__, filename, errstr);
+		logerror(lf, "%s:%d Problem writing to output file \'%s\'.\n", __func__,
+		         __LINE__, bc->outfile);
 		return 1;
 	}
 
-	gzf = gzdopen(fd, "ab");
-	ret = gzwrite(gzf, buffer, len);
-	if (ret <= 0)
+	/* Closing the file also releases its lock */
+	if (!aio_enabled())
 	{
-		logerror(lf, "%s:%d Problem writing to output file \'%s\': %s.\n", __func__,
-		         __LINE__, filename);
-		return 1;
+		close(bc->fd[orient]);
+		bc->fd[orient] = -1;
 	}
-	gzclose(gzf);
 
 	/* Reset buffer */
-	bc->curr_bytes = 0;
-	memset(bc->buffer, 0, BUFLEN);
-	bc->buffer[0] = '\0';
-
-	/* Unlock output file */
-	fl.l_type = F_UNLCK;
-	fcntl(fd, F_SETLK, &fl);
-
-	/* Close output file */
-	close(fd);
-
-	/* Free allocated memory */
-	free(filename);
+	bc->curr_bytes[orient] = 0;
+	bc->buffer[orient][0] = '\0';
 
 	return 0;
 }
@@ -0,0 +1,94 @@
+/* file: flush_pools.c
+ * description: Dumps the remaining output buffers of all samples to file
+ * author: Daniel Garrigan Lummei Analytics LLC
+ * updated: November 2016
+ * email: dgarriga@lummei.net
+ * copyright: MIT license
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "khash.h"
+#include "ddradseq.h"
+
+int flush_pools(const CMD *cp, int orient, const khash_t(pool_hash) *h)
+{
+	int ret = 0;
+	khint_t i = 0;
+	khint_t j = 0;
+	khint_t k = 0;
+	khash_t(barcode) *b = NULL;
+	khash_t(pool) *p = NULL;
+	BARCODE *bc = NULL;
+	POOL *pl = NULL;
+	FILE *lf = cp->lf;
+
+	/* Flush remaining data in buffers */
+	for (i = kh_begin(h); i != kh_end(h); i++)
+	{
+		if (kh_exist(h, i))
+		{
+			p = kh_value(h, i);
+			for (j = kh_begin(p); j != kh_end(p); j++)
+			{
+				if (kh_exist(p, j))
+				{
+					pl = kh_value(p, j);
+					b = pl->b;
+					for (k = kh_begin(b); k != kh_end(b); k++)
+					{
+						if (kh_exist(b, k))
+						{
+							bc = kh_value(b, k);
+							if (bc->curr_bytes[orient] > 0)
+							{
+								ret = flush_buffer(cp, orient, bc);
+								if (ret)
+								{
+									logerror(lf, "%s:%d Problem writing buffer to file.\n",
+									         __func__, __LINE__);
+									return 1;
+								}
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+
+	/* Wait for the outstanding writes before closing the output files */
+	if (aio_enabled())
+	{
+		ret = aio_drain();
+		if (ret)
+		{
+			logerror(lf, "%s:%d Problem writing buffer to file.\n", __func__, __LINE__);
+			return 1;
+		}
+		for (i = kh_begin(h); i != kh_end(h); i++)
+		{
+			if (!kh_exist(h, i))
+				continue;
+			p = kh_value(h, i);
+			for (j = kh_begin(p); j != kh_end(p); j++)
+			{
+				if (!kh_exist(p, j))
+					continue;
+				b = kh_value(p, j)->b;
+				for (k = kh_begin(b); k != kh_end(b); k++)
+				{
+					if (kh_exist(b, k) && kh_value(b, k)->fd[orient] >= 0)
+					{
+						bc = kh_value(b, k);
+						close(bc->fd[orient]);
+						bc->fd[orient] = -1;
+					}
+				}
+			}
+		}
+	}
+
+	return 0;
+}
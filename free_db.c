@@ -44,7 +44,8 @@ int free_db(khash_t(pool_hash) *h)
 							bc = kh_value(b, k);
 							free(bc->smplID);
 							free(bc->outfile);
-							free(bc->buffer);
+							free(bc->buffer[FORWARD]);
+							free(bc->buffer[REVERSE]);
 							free(bc);
 							free((void*)key);
 						}
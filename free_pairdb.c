@@ -10,14 +10,15 @@
 #include "khash.h"
 #include "ddradseq.h"
 
-int free_pairdb(khash_t(fastq) *h)
+int free_pairdb(PAIRDB *db)
 {
-	const char *key;
-	FASTQ *e = NULL;
-
-	if (h == NULL)
+	if (db == NULL)
 		return 1;
-	kh_foreach(h, key, e, free(e->id); free(e->seq); free(e->qual); free(e); free((void*)key););
-	kh_destroy(fastq, h);
+
+	/* Keys and entries live in the arena, which is released chunk by chunk */
+	if (db->h)
+		kh_destroy(fastq, db->h);
+	arena_destroy(db->arena);
+	free(db);
 	return 0;
 }
@@ -18,6 +18,26 @@
 extern int errno;
 const char *argp_program_version = "ddradseq v1.4";
 const char *argp_program_bug_address = "<dgarriga@lummei.net>";
+
+/* Keys for options without a short form */
+enum
+{
+	OPT_PART = 256,
+	OPT_AIO_DEPTH,
+	OPT_PARSE_LEVEL,
+	OPT_PAIR_LEVEL,
+	OPT_FINAL_LEVEL,
+	OPT_ZSTD,
+	OPT_R1,
+	OPT_R2,
+	OPT_FLOWCELL,
+	OPT_LANE,
+	OPT_INTERLEAVED,
+	OPT_PREFETCH,
+	OPT_PAIR_MEM,
+	OPT_BAND
+};
+
 static struct argp_option options[] =
 {
   {"across",  'a', 0,      0, "Pool sequences across flow cells [default: false]"},
@@ -28,8 +48,22 @@ static struct argp_option options[] =
   {"score",   's', "INT",  0, "Alignment score to consider mates properly paired [default: 100]"},
   {"gapo",    'g', "INT",  0, "Penalty for opening a gap [default: 5]"},
   {"gape",    'e', "INT",  0, "Penalty for extending open gap [default: 1]"},
+  {"band",    OPT_BAND, "INT", 0, "Diagonals either side of the mate overlap that gaps may reach (0 for a full local alignment) [default: 8]"},
   {"pattern", 'p', "STR",  0, "Input fastQ file glob pattern to match [default: \"*.fastq.gz\""},
   {"threads", 't', "INT",  0, "Number of threads available for concurrency [default: 1]"},
+  {"part",    OPT_PART, "STR", 0, "Write parse output to per-writer part files tagged STR"},
+  {"aio-depth", OPT_AIO_DEPTH, "INT", 0, "Number of asynchronous (io_uring) output writes in flight [default: 0]"},
+  {"parse-level", OPT_PARSE_LEVEL, "INT", 0, "Compression level of parse output files [default: 1]"},
+  {"pair-level", OPT_PAIR_LEVEL, "INT", 0, "Compression level of pair output files [default: 1]"},
+  {"final-level", OPT_FINAL_LEVEL, "INT", 0, "Compression level of final output files [default: 6]"},
+  {"zstd",    OPT_ZSTD, 0,     0, "Write Zstandard-compressed (.fq.zst) output files [default: false]"},
+  {"r1",      OPT_R1, "FILE",  0, "Forward or interleaved fastQ input file or pipe (\'-\' for stdin) instead of INPUT_DIRECTORY"},
+  {"r2",      OPT_R2, "FILE",  0, "Reverse fastQ input file or pipe (\'-\' for stdin) instead of INPUT_DIRECTORY"},
+  {"flowcell", OPT_FLOWCELL, "STR", 0, "Flow cell of the \'--r1\' input [default: read from each entry]"},
+  {"lane",    OPT_LANE, "STR", 0, "Lane of the \'--r1\' input, which tags parse part files"},
+  {"interleaved", OPT_INTERLEAVED, 0, 0, "Each input file holds both mates of its pairs in turn [default: false]"},
+  {"prefetch", OPT_PREFETCH, "MB", 0, "Megabytes of the next input files to read ahead [default: 256]"},
+  {"pair-mem", OPT_PAIR_MEM, "MB", 0, "Megabytes of entries held while pairing before sorting on disk [default: 0, no limit]"},
   {0}
 };
 
@@ -60,6 +94,9 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state)
 		case 'e':
 			cp->gape = atoi(arg);
 			break;
+		case OPT_BAND:
+			cp->band = atoi(arg);
+			break;
 		case 't':
 			cp->nthreads = atoi(arg);
 			if (cp->nthreads > 1)
@@ -71,13 +108,52 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state)
 		case 'c':
 			cp->csvfile = strdup(arg);
 			break;
+		case OPT_PART:
+			cp->part = strdup(arg);
+			break;
+		case OPT_AIO_DEPTH:
+			cp->aio_depth = atoi(arg);
+			break;
+		case OPT_PARSE_LEVEL:
+			cp->parse_level = atoi(arg);
+			break;
+		case OPT_PAIR_LEVEL:
+			cp->pair_level = atoi(arg);
+			break;
+		case OPT_FINAL_LEVEL:
+			cp->final_level = atoi(arg);
+			break;
+		case OPT_ZSTD:
+			cp->format = ZSTD_FORMAT;
+			break;
+		case OPT_R1:
+			cp->r1 = strdup(string_equal(arg, "-") ? "/dev/stdin" : arg);
+			break;
+		case OPT_R2:
+			cp->r2 = strdup(string_equal(arg, "-") ? "/dev/stdin" : arg);
+			break;
+		case OPT_FLOWCELL:
+			cp->flowcell = strdup(arg);
+			break;
+		case OPT_LANE:
+			cp->lane = strdup(arg);
+			break;
+		case OPT_INTERLEAVED:
+			cp->interleaved = true;
+			break;
+		case OPT_PREFETCH:
+			cp->prefetch = atoi(arg);
+			break;
+		case OPT_PAIR_MEM:
+			cp->pair_mem = atoi(arg);
+			break;
 		case ARGP_KEY_ARG:
 			if (state->arg_num >= 1)
 				argp_usage(state);
 			cp->parent_indir = strdup(arg);
 			break;
 		case ARGP_KEY_END:
-			if (state->arg_num < 1)
+			if (state->arg_num < 1 && !cp->r1)
 				argp_usage(state);
 			break;
 		default:
@@ -90,13 +166,14 @@ static char args_doc[] = "INPUT_DIRECTORY";
 
 static char doc[] =
 "Parses fastQ files by flow cell, barcode, and/or index.\v"
-"Valid run-time modes are \'parse\', \'pair\', and \'trimend\'. See https://github.com/dgarriga/ddradseq for documentation";
+"Valid run-time modes are \'parse\', \'merge\', \'pair\', and \'trimend\'. See https://github.com/dgarriga/ddradseq for documentation";
 
 static struct argp argp = {options, parse_opt, args_doc, doc};
 
 CMD *get_cmdline(int argc, char *argv[])
 {
 	char *datec = NULL;
+	int maxlevel = 0;
 	size_t strl = 0;
 	time_t rawtime;
 	struct tm *timeinfo;
@@ -113,6 +190,7 @@ CMD *get_cmdline(int argc, char *argv[])
 	/* Set argument defaults */
 	cp->across = false;
 	cp->mt_mode = false;
+	cp->interleaved = false;
 	cp->parent_indir = NULL;
 	cp->parent_outdir = NULL;
 	cp->outdir = NULL;
@@ -122,8 +200,21 @@ CMD *get_cmdline(int argc, char *argv[])
 	cp->score = 100;
 	cp->gapo = 5;
 	cp->gape = 1;
+	cp->band = 8;
 	cp->glob = NULL;
+	cp->part = NULL;
+	cp->r1 = NULL;
+	cp->r2 = NULL;
+	cp->flowcell = NULL;
+	cp->lane = NULL;
 	cp->nthreads = 1;
+	cp->aio_depth = 0;
+	cp->prefetch = 256;
+	cp->pair_mem = 0;
+	cp->parse_level = 1;
+	cp->pair_level = 1;
+	cp->final_level = 6;
+	cp->format = GZIP_FORMAT;
 	cp->lf = NULL;
 
 	argp_parse(&argp, argc, argv, 0, 0, cp);
@@ -132,7 +223,7 @@ CMD *get_cmdline(int argc, char *argv[])
 	if (!cp->mode)
 		cp->mode = strdup("all");
 	else if (!string_equal(cp->mode, "parse") && !string_equal(cp->mode, "pair")  &&
-	    !string_equal(cp->mode, "trimend"))
+	    !string_equal(cp->mode, "trimend") && !string_equal(cp->mode, "merge"))
 	{
 		fprintf(stderr, "ERROR: %s is not a valid mode.\n", cp->mode);
 		return NULL;
@@ -148,6 +239,102 @@ CMD *get_cmdline(int argc, char *argv[])
 		return NULL;
 	}
 
+	if (!cp->parent_outdir && string_equal(cp->mode, "merge"))
+	{
+		fputs("ERROR: \'--out\' switch is mandatory when running merge mode.\n", stderr);
+		return NULL;
+	}
+	if (cp->interleaved && cp->r2)
+	{
+		fputs("ERROR: \'--r2\' switch cannot be used with interleaved input.\n", stderr);
+		return NULL;
+	}
+	if (!cp->interleaved && !cp->r1 != !cp->r2)
+	{
+		fputs("ERROR: \'--r1\' and \'--r2\' switches must be used together.\n", stderr);
+		return NULL;
+	}
+	if (cp->r2 && string_equal(cp->r1, cp->r2))
+	{
+		fputs("ERROR: \'--r1\' and \'--r2\' must name different inputs.\n", stderr);
+		return NULL;
+	}
+	if ((cp->r1 || cp->interleaved) && !string_equal(cp->mode, "parse") &&
+	    !string_equal(cp->mode, "all"))
+	{
+		fputs("ERROR: input switches can only be used in parse mode.\n", stderr);
+		return NULL;
+	}
+	if ((cp->flowcell || cp->lane) && !cp->r1)
+	{
+		fputs("ERROR: \'--flowcell\' and \'--lane\' switches require \'--r1\'.\n", stderr);
+		return NULL;
+	}
+
+	/* Separate lanes streamed by concurrent processes write their own part files */
+	if (cp->lane && !cp->part && string_equal(cp->mode, "parse"))
+	{
+		cp->part = malloc(strlen(cp->lane) + 2u);
+		if (UNLIKELY(!cp->part))
+		{
+			perror("Memory allocation failure");
+			return NULL;
+		}
+		sprintf(cp->part, "L%s", cp->lane);
+	}
+	if (cp->part && !string_equal(cp->mode, "parse"))
+	{
+		fputs("ERROR: \'--part\' switch can only be used in parse mode.\n", stderr);
+		return NULL;
+	}
+	if (cp->part && (*cp->part == '\0' || strchr(cp->part, '/')))
+	{
+		fprintf(stderr, "ERROR: %s is not a valid part file tag.\n", cp->part);
+		return NULL;
+	}
+
+	if (cp->aio_depth < 0)
+	{
+		fprintf(stderr, "ERROR: %d is not a valid number of writes in flight.\n", cp->aio_depth);
+		return NULL;
+	}
+	if (cp->band < 0)
+	{
+		fprintf(stderr, "ERROR: %d is not a valid alignment band.\n", cp->band);
+		return NULL;
+	}
+	if (cp->prefetch < 0)
+	{
+		fprintf(stderr, "ERROR: %d is not a valid read ahead size.\n", cp->prefetch);
+		return NULL;
+	}
+	if (cp->pair_mem < 0)
+	{
+		fprintf(stderr, "ERROR: %d is not a valid pairing memory budget.\n", cp->pair_mem);
+		return NULL;
+	}
+	if (cp->pair_mem > 0 && cp->pair_mem < PAIR_MEM_MIN)
+	{
+		fprintf(stderr, "ERROR: A pairing memory budget must be 0 or at least %d Mb.\n",
+		        PAIR_MEM_MIN);
+		return NULL;
+	}
+#ifndef HAVE_ZSTD
+	if (cp->format == ZSTD_FORMAT)
+	{
+		fputs("ERROR: ddradseq was compiled without Zstandard support.\n", stderr);
+		return NULL;
+	}
+#endif
+	maxlevel = cp->format == ZSTD_FORMAT ? MAX_ZSTD_LEVEL : MAX_LEVEL;
+	if (cp->parse_level < 0 || cp->parse_level > maxlevel ||
+	    cp->pair_level < 0 || cp->pair_level > maxlevel ||
+	    cp->final_level < 0 || cp->final_level > maxlevel)
+	{
+		fprintf(stderr, "ERROR: compression levels must be between 0 and %d.\n", maxlevel);
+		return NULL;
+	}
+
 	if (!cp->glob && (string_equal(cp->mode, "parse") || string_equal(cp->mode, "all")))
 		cp->glob = strdup("*.fastq.gz");
 
@@ -0,0 +1,34 @@
+/* file: init_pairdb.c
+ * description: Creates an empty forward fastQ database
+ * author: Daniel Garrigan Lummei Analytics LLC
+ * updated: November 2016
+ * email: dgarriga@lummei.net
+ * copyright: MIT license
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "khash.h"
+#include "ddradseq.h"
+
+PAIRDB *init_pairdb(FILE *lf)
+{
+	PAIRDB *db = NULL;
+
+	db = calloc(1, sizeof(PAIRDB));
+	if (UNLIKELY(!db))
+	{
+		logerror(lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
+		return NULL;
+	}
+	db->h = kh_init(fastq);
+	db->arena = arena_create(lf);
+	if (UNLIKELY(!db->h || !db->arena))
+	{
+		logerror(lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
+		free_pairdb(db);
+		return NULL;
+	}
+
+	return db;
+}
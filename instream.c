@@ -0,0 +1,368 @@
+/* file: instream.c
+ * description: Input file streams for gzip, Zstandard and uncompressed files and pipes
+ * author: Daniel Garrigan Lummei Analytics LLC
+ * updated: November 2016
+ * email: dgarriga@lummei.net
+ * copyright: MIT license
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#include "ddradseq.h"
+
+extern int errno;
+
+/* Initial size of a line buffer, which grows as needed */
+#define LINE_START 256
+
+/* Magic numbers at the start of every Zstandard frame and gzip member */
+static const unsigned char zstd_magic[4] = {0x28, 0xb5, 0x2f, 0xfd};
+static const unsigned char gzip_magic[2] = {0x1f, 0x8b};
+
+/* Window bits value that selects gzip decoding */
+#define GZIP_WBITS 31
+
+/* Function prototypes */
+static int instream_probe(INSTREAM *s);
+static int instream_fill(INSTREAM *s);
+static long decode_gzip(INSTREAM *s);
+static long decode_zstd(INSTREAM *s);
+
+INSTREAM *instream_open(const char *filename, FILE *lf)
+{
+	char *errstr = NULL;
+	int fd = 0;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0)
+	{
+		errstr = strerror(errno);
+		logerror(lf, "%s:%d Unable to open file \'%s\': %s.\n", __func__, __LINE__,
+		         filename, errstr);
+		return NULL;
+	}
+	return instream_fdopen(fd, filename, lf);
+}
+
+INSTREAM *instream_fdopen(int fd, const char *filename, FILE *lf)
+{
+	struct stat st;
+	INSTREAM *s = NULL;
+
+	s = calloc(1, sizeof(INSTREAM));
+	if (UNLIKELY(!s))
+	{
+		logerror(lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
+		close(fd);
+		return NULL;
+	}
+	s->lf = lf;
+	s->fd = fd;
+	s->pipe = fstat(fd, &st) < 0 || !S_ISREG(st.st_mode);
+	s->ibuf = malloc(BUFLEN);
+	s->obuf = malloc(BUFLEN);
+	s->filename = strdup(filename);
+	if (UNLIKELY(!s->ibuf || !s->obuf || !s->filename))
+	{
+		logerror(lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
+		instream_close(s);
+		return NULL;
+	}
+	return s;
+}
+
+long instream_read(INSTREAM *s, char *buf, size_t len)
+{
+	size_t done = 0;
+	size_t n = 0;
+
+	/* Copy decoded data until the request is met or the stream ends; */
+	/* a pipe returns early rather than wait for more input */
+	while (done < len)
+	{
+		if (s->pipe && done > 0 && s->opos == s->olen && s->ipos == s->ilen)
+			break;
+		if (instream_fill(s))
+			return -1;
+		if (s->opos == s->olen)
+			break;
+		n = s->olen - s->opos;
+		if (n > len - done)
+			n = len - done;
+		memcpy(buf + done, s->obuf + s->opos, n);
+		s->opos += n;
+		done += n;
+	}
+	return (long)done;
+}
+
+long instream_getline(INSTREAM *s, char **line, size_t *cap)
+{
+	char *tmp = NULL;
+	char *nl = NULL;
+	size_t len = 0;
+	size_t n = 0;
+
+	if (!*line || *cap < 2u)
+	{
+		tmp = realloc(*line, LINE_START);
+		if (UNLIKELY(!tmp))
+		{
+			logerror(s->lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
+			return -1;
+		}
+		*line = tmp;
+		*cap = LINE_START;
+	}
+
+	while (1)
+	{
+		/* Double the line buffer once it is full */
+		if (*cap - len < 2u)
+		{
+			tmp = realloc(*line, 2u * *cap);
+			if (UNLIKELY(!tmp))
+			{
+				logerror(s->lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
+				return -1;
+			}
+			*line = tmp;
+			*cap *= 2u;
+		}
+
+		/* Copy up to and including the next newline */
+		if (instream_fill(s))
+			return -1;
+		if (s->opos == s->olen)
+			break;
+		n = s->olen - s->opos;
+		if (n > *cap - len - 1u)
+			n = *cap - len - 1u;
+		nl = memchr(s->obuf + s->opos, '\n', n);
+		if (nl)
+			n = nl - (s->obuf + s->opos) + 1u;
+		memcpy(*line + len, s->obuf + s->opos, n);
+		s->opos += n;
+		len += n;
+		if (nl)
+			break;
+	}
+	(*line)[len] = '\0';
+	return (long)len;
+}
+
+bool instream_eof(INSTREAM *s)
+{
+	return s->eof && s->opos == s->olen;
+}
+
+void instream_close(INSTREAM *s)
+{
+	if (s->zs)
+	{
+		inflateEnd(s->zs);
+		free(s->zs);
+	}
+#ifdef HAVE_ZSTD
+	if (s->zd)
+		ZSTD_freeDStream(s->zd);
+#endif
+	close(s->fd);
+	free(s->filename);
+	free(s->ibuf);
+	free(s->obuf);
+	free(s);
+}
+
+static int instream_fill(INSTREAM *s)
+{
+	char *errstr = NULL;
+	char *tmp = NULL;
+	ssize_t nr = 0;
+	long n = 0;
+
+	/* Decoded data is still waiting to be consumed */
+	if (s->opos < s->olen || s->eof)
+		return 0;
+
+	/* Nothing is read until the data is needed, so that opening */
+	/* one pipe never waits for the writer of another */
+	if (!s->probed && instream_probe(s))
+		return 1;
+
+	s->opos = 0;
+	s->olen = 0;
+	while (1)
+	{
+		/* Read more input once the last block is used up */
+		if (s->ipos == s->ilen && !s->ieof)
+		{
+			nr = read(s->fd, s->ibuf, BUFLEN);
+			if (nr < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				errstr = strerror(errno);
+				logerror(s->lf, "%s:%d Failed to read input data: %s.\n", __func__,
+				         __LINE__, errstr);
+				return 1;
+			}
+			s->ipos = 0;
+			s->ilen = nr;
+			if (nr == 0)
+				s->ieof = true;
+		}
+
+		/* A compressed stream ends cleanly only between frames */
+		if (s->ieof && s->ipos == s->ilen && !s->midframe)
+		{
+			s->eof = true;
+			return 0;
+		}
+
+		/* Uncompressed input is handed over by swapping the buffers */
+		if (!s->format)
+		{
+			tmp = s->obuf;
+			s->obuf = s->ibuf;
+			s->ibuf = tmp;
+			s->opos = s->ipos;
+			s->olen = s->ilen;
+			s->ipos = 0;
+			s->ilen = 0;
+			return 0;
+		}
+
+		n = s->format == ZSTD_FORMAT ? decode_zstd(s) : decode_gzip(s);
+		if (n < 0)
+			return 1;
+		if (n > 0)
+		{
+			s->olen = n;
+			return 0;
+		}
+		if (s->ieof && s->ipos == s->ilen && s->midframe)
+		{
+			logerror(s->lf, "%s:%d Truncated compressed input file.\n", __func__, __LINE__);
+			return 1;
+		}
+	}
+}
+
+static int instream_probe(INSTREAM *s)
+{
+	char *errstr = NULL;
+	ssize_t nr = 0;
+
+	/* Identify the compression format from the first bytes of the stream, */
+	/* which are read rather than peeked at so that pipes work as well */
+	while (s->ilen < sizeof(zstd_magic) && !s->ieof)
+	{
+		nr = read(s->fd, s->ibuf + s->ilen, BUFLEN - s->ilen);
+		if (nr < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			errstr = strerror(errno);
+			logerror(s->lf, "%s:%d Failed to read file \'%s\': %s.\n", __func__, __LINE__,
+			         s->filename, errstr);
+			return 1;
+		}
+		s->ilen += nr;
+		if (nr == 0)
+			s->ieof = true;
+	}
+	s->probed = true;
+	if (s->ilen >= sizeof(zstd_magic) && memcmp(s->ibuf, zstd_magic, sizeof(zstd_magic)) == 0)
+	{
+#ifdef HAVE_ZSTD
+		s->format = ZSTD_FORMAT;
+		s->zd = ZSTD_createDStream();
+		if (UNLIKELY(!s->zd))
+		{
+			logerror(s->lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
+			return 1;
+		}
+		ZSTD_initDStream(s->zd);
+#else
+		logerror(s->lf, "%s:%d File \'%s\' is Zstandard-compressed, but ddradseq was "
+		         "compiled without Zstandard support.\n", __func__, __LINE__, s->filename);
+		return 1;
+#endif
+	}
+	else if (s->ilen >= sizeof(gzip_magic) && memcmp(s->ibuf, gzip_magic, sizeof(gzip_magic)) == 0)
+	{
+		s->format = GZIP_FORMAT;
+		s->zs = calloc(1, sizeof(z_stream));
+		if (UNLIKELY(!s->zs) || inflateInit2(s->zs, GZIP_WBITS) != Z_OK)
+		{
+			logerror(s->lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
+			free(s->zs);
+			s->zs = NULL;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static long decode_gzip(INSTREAM *s)
+{
+	int ret = 0;
+
+	s->zs->next_in = (unsigned char*)s->ibuf + s->ipos;
+	s->zs->avail_in = s->ilen - s->ipos;
+	s->zs->next_out = (unsigned char*)s->obuf;
+	s->zs->avail_out = BUFLEN;
+	ret = inflate(s->zs, Z_NO_FLUSH);
+	if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR)
+	{
+		logerror(s->lf, "%s:%d gzip decompression error: %s.\n", __func__, __LINE__,
+		         s->zs->msg ? s->zs->msg : "corrupt data");
+		return -1;
+	}
+	s->ipos = s->ilen - s->zs->avail_in;
+
+	/* Files may hold any number of concatenated gzip members */
+	s->midframe = ret != Z_STREAM_END;
+	if (ret == Z_STREAM_END && inflateReset(s->zs) != Z_OK)
+		return -1;
+	return (long)(BUFLEN - s->zs->avail_out);
+}
+
+static long decode_zstd(INSTREAM *s)
+{
+#ifdef HAVE_ZSTD
+	size_t ret = 0;
+	ZSTD_inBuffer in;
+	ZSTD_outBuffer out;
+
+	in.src = s->ibuf;
+	in.size = s->ilen;
+	in.pos = s->ipos;
+	out.dst = s->obuf;
+	out.size = BUFLEN;
+	out.pos = 0;
+	ret = ZSTD_decompressStream(s->zd, &out, &in);
+	if (ZSTD_isError(ret))
+	{
+		logerror(s->lf, "%s:%d Zstandard decompression error: %s.\n", __func__,
+		         __LINE__, ZSTD_getErrorName(ret));
+		return -1;
+	}
+	s->ipos = in.pos;
+	s->midframe = ret != 0;
+	return (long)out.pos;
+#else
+	/* Zstandard streams are never opened without Zstandard support */
+	return -1;
+#endif
+}
@@ -0,0 +1,107 @@
+/* file: link_file.c
+ * description: Puts an unchanged copy of a file at a new path without rewriting it
+ * author: Daniel Garrigan Lummei Analytics LLC
+ * updated: November 2016
+ * email: dgarriga@lummei.net
+ * copyright: MIT license
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+#include "ddradseq.h"
+
+extern int errno;
+
+/* Function prototypes */
+static int copy_data(int in, int out);
+
+int link_file(const char *src, const char *dst, FILE *lf)
+{
+	char *errstr = NULL;
+	int in = -1;
+	int out = -1;
+	mode_t mode;
+
+	/* Set permissions if new output file needs to be created */
+	mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH;
+
+	/* An earlier output is removed rather than truncated, as it */
+	/* may share its data with an input */
+	if (unlink(dst) < 0 && errno != ENOENT)
+		goto fail;
+
+	/* A hard link copies nothing at all */
+	if (link(src, dst) == 0)
+		return 0;
+
+	/* Across file systems, or where links are not allowed, the data is */
+	/* cloned where the file system shares extents, and copied otherwise */
+	in = open(src, O_RDONLY);
+	if (in < 0)
+		goto fail;
+	out = open(dst, O_WRONLY | O_CREAT | O_TRUNC, mode);
+	if (out < 0)
+		goto fail;
+	if (ioctl(out, FICLONE, in) < 0 && copy_data(in, out))
+		goto fail;
+	close(in);
+	if (close(out) < 0)
+	{
+		out = -1;
+		goto fail;
+	}
+	return 0;
+
+fail:
+	errstr = strerror(errno);
+	logerror(lf, "%s:%d Unable to copy \'%s\' to \'%s\': %s.\n", __func__, __LINE__, src, dst,
+	         errstr);
+	if (in >= 0)
+		close(in);
+	if (out >= 0)
+		close(out);
+	return 1;
+}
+
+static int copy_data(int in, int out)
+{
+	char *buf = NULL;
+	ssize_t n = 0;
+	ssize_t w = 0;
+	ssize_t done = 0;
+
+	/* The kernel copies the data itself where it can */
+	while ((n = copy_file_range(in, NULL, out, NULL, 0x40000000, 0)) > 0);
+	if (n == 0)
+		return 0;
+	if (errno != ENOSYS && errno != EXDEV && errno != EINVAL && errno != EOPNOTSUPP)
+		return 1;
+
+	/* Otherwise through a buffer, from wherever the copy stopped */
+	buf = malloc(BUFLEN);
+	if (UNLIKELY(!buf))
+		return 1;
+	while ((n = read(in, buf, BUFLEN)) > 0)
+	{
+		for (done = 0; done < n; done += w)
+		{
+			w = write(out, buf + done, n - done);
+			if (w < 0)
+			{
+				free(buf);
+				return 1;
+			}
+		}
+	}
+	free(buf);
+	return n < 0;
+}
@@ -61,11 +61,36 @@ int log_init(CMD *cp)
 	ncpus = sysconf(_SC_NPROCESSORS_ONLN);
 
 	/* Print information on starting parameters */
-	loginfo(cp->lf, "user specified directory %s for input.\n", cp->parent_indir);
-	loginfo(cp->lf, "searching for glob pattern \'%s\' for input files.\n", cp->glob);
+	if (cp->r1)
+	{
+		if (cp->r2)
+			loginfo(cp->lf, "user specified \'%s\' and \'%s\' as input streams.\n", cp->r1, cp->r2);
+		else
+			loginfo(cp->lf, "user specified \'%s\' as interleaved input stream.\n", cp->r1);
+		if (cp->flowcell)
+			loginfo(cp->lf, "input streams are from flow cell %s.\n", cp->flowcell);
+		if (cp->lane)
+			loginfo(cp->lf, "input streams are from lane %s.\n", cp->lane);
+	}
+	else
+	{
+		loginfo(cp->lf, "user specified directory %s for input.\n", cp->parent_indir);
+		loginfo(cp->lf, "searching for glob pattern \'%s\' for input files.\n", cp->glob);
+		if (cp->interleaved)
+			loginfo(cp->lf, "input files hold interleaved mate pairs.\n");
+	}
 	loginfo(cp->lf, "user specified \'%s\' as database file.\n", cp->csvfile);
 	loginfo(cp->lf, "user specified \'%s\' as output directory.\n", cp->parent_outdir);
 	loginfo(cp->lf, "output will be written to \'%s\'.\n", cp->outdir);
+	if (cp->part)
+		loginfo(cp->lf, "parse output will be written to part files tagged \'%s\'.\n", cp->part);
+	loginfo(cp->lf, "output is %s-compressed at levels %d (parse), %d (pair), and %d (final).\n",
+	        cp->format == ZSTD_FORMAT ? "Zstandard" : "gzip", cp->parse_level, cp->pair_level,
+	        cp->final_level);
+	if (cp->pair_mem)
+		loginfo(cp->lf, "pairing will hold up to %d Mb of entries before sorting on disk.\n", cp->pair_mem);
+	if (cp->prefetch)
+		loginfo(cp->lf, "up to %d Mb of the next input files will be read ahead.\n", cp->prefetch);
 	loginfo(cp->lf, "program will use edit distance of %d base difference.\n", cp->dist);
 	if (cp->mt_mode)
 		loginfo(cp->lf, "program is running in multi-threaded mode using %d threads.\n", cp->nthreads);
@@ -0,0 +1,30 @@
+/* file: mate_key.c
+ * description: Finds the mate pair key in the identifier line of a fastQ entry
+ * author: Daniel Garrigan Lummei Analytics LLC
+ * updated: November 2016
+ * email: dgarriga@lummei.net
+ * copyright: MIT license
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "ddradseq.h"
+
+int mate_key(const FQREC *rec, const char **key, size_t *klen, FILE *lf)
+{
+	const char *pstart = NULL;
+	const char *pend = NULL;
+
+	/* The key runs from the first colon to the space of the identifier line */
+	pstart = memchr(rec->id, ':', rec->idlen);
+	pend = memchr(rec->id, ' ', rec->idlen);
+	if (UNLIKELY(!pstart || !pend || pend < pstart))
+	{
+		logerror(lf, "%s:%d fastQ header parsing error.\n", __func__, __LINE__);
+		return 1;
+	}
+	*key = pstart + 1;
+	*klen = pend - pstart - 1;
+
+	return 0;
+}
@@ -0,0 +1,105 @@
+/* file: merge_main.c
+ * description: Entry point for the merge modality
+ * author: Daniel Garrigan Lummei Analytics LLC
+ * updated: November 2016
+ * email: dgarriga@lummei.net
+ * copyright: MIT license
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ddradseq.h"
+
+/* Function prototypes */
+static char *part_to_final(const char *part);
+
+int merge_main(const CMD *cp)
+{
+	char **filelist = NULL;
+	int ret = 0;
+	unsigned int i = 0;
+	unsigned int j = 0;
+	unsigned int nfiles = 0;
+	unsigned int nmerged = 0;
+	FILE *lf = cp->lf;
+
+	/* Get sorted list of all part files */
+	/* Parts of the same sample are adjacent in the sorted list */
+	nfiles = traverse_dirtree(cp, __func__, &filelist);
+	if (!filelist)
+		return 1;
+
+	if (nfiles < 1)
+	{
+		logerror(lf, "%s:%d No part files found.\n", __func__, __LINE__);
+		return 1;
+	}
+
+	for (i = 0; i < nfiles; i = j)
+	{
+		char *fout = NULL;
+		char *fnext = NULL;
+
+		/* Construct merged output file name */
+		fout = part_to_final(filelist[i]);
+		if (UNLIKELY(!fout))
+		{
+			logerror(lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
+			return 1;
+		}
+
+		/* Find all parts that belong to the same output file */
+		for (j = i + 1; j < nfiles; j++)
+		{
+			fnext = part_to_final(filelist[j]);
+			if (UNLIKELY(!fnext))
+			{
+				logerror(lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
+				return 1;
+			}
+			ret = string_equal(fout, fnext);
+			free(fnext);
+			if (!ret)
+				break;
+		}
+
+		/* Print informational update to log file */
+		loginfo(lf, "Merging %u part files into \'%s\'.\n", j - i, fout);
+
+		ret = merge_parts(fout, &filelist[i], j - i, lf);
+		if (ret)
+			return 1;
+		nmerged++;
+
+		/* Free allocated memory */
+		free(fout);
+	}
+
+	/* Print informational message to log file */
+	loginfo(lf, "Done merging part files into %u files in \'%s\'.\n", nmerged, cp->outdir);
+
+	/* Deallocate memory */
+	for (i = 0; i < nfiles; i++)
+		free(filelist[i]);
+	free(filelist);
+
+	return 0;
+}
+
+static char *part_to_final(const char *part)
+{
+	char *final = NULL;
+	char *pstart = NULL;
+	char *pend = NULL;
+
+	/* Cut the ".part-<tag>" from "smpl_<ID>.R1.part-<tag>.fq.gz" (or ".fq.zst") */
+	final = strdup(part);
+	if (UNLIKELY(!final))
+		return NULL;
+	pstart = strrchr(final, '/');
+	pstart = strstr(pstart ? pstart : final, ".part-");
+	pend = strstr(pstart, ".fq.");
+	memmove(pstart, pend, strlen(pend) + 1u);
+	return final;
+}
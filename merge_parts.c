@@ -0,0 +1,120 @@
+/* file: merge_parts.c
+ * description: Concatenates compressed part files into one output file
+ * author: Daniel Garrigan Lummei Analytics LLC
+ * updated: November 2016
+ * email: dgarriga@lummei.net
+ * copyright: MIT license
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "ddradseq.h"
+
+extern int errno;
+
+/* Function prototypes */
+static int append_part(int fdout, int fdin);
+
+int merge_parts(const char *outfile, char **parts, const unsigned int nparts, FILE *lf)
+{
+	char *errstr = NULL;
+	int fdin;
+	int fdout;
+	unsigned int i = 0;
+	mode_t mode;
+
+	/* Set permissions if new output file needs to be created */
+	mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH;
+
+	/* Open merged output file */
+	fdout = open(outfile, O_WRONLY | O_CREAT | O_TRUNC, mode);
+	if (fdout < 0)
+	{
+		errstr = strerror(errno);
+		logerror(lf, "%s:%d Unable to open output file \'%s\': %s.\n", __func__,
+		         __LINE__, outfile, errstr);
+		return 1;
+	}
+
+	/* A gzip file may hold any number of members, so the compressed */
+	/* parts are appended as they are without being recompressed */
+	for (i = 0; i < nparts; i++)
+	{
+		fdin = open(parts[i], O_RDONLY);
+		if (fdin < 0)
+		{
+			errstr = strerror(errno);
+			logerror(lf, "%s:%d Unable to open part file \'%s\': %s.\n", __func__,
+			         __LINE__, parts[i], errstr);
+			close(fdout);
+			return 1;
+		}
+		if (append_part(fdout, fdin))
+		{
+			errstr = strerror(errno);
+			logerror(lf, "%s:%d Failed to append part file \'%s\' to \'%s\': %s.\n",
+			         __func__, __LINE__, parts[i], outfile, errstr);
+			close(fdin);
+			close(fdout);
+			return 1;
+		}
+		close(fdin);
+	}
+
+	/* Close merged output file */
+	if (close(fdout) < 0)
+	{
+		errstr = strerror(errno);
+		logerror(lf, "%s:%d Failed to close output file \'%s\': %s.\n", __func__,
+		         __LINE__, outfile, errstr);
+		return 1;
+	}
+
+	/* Remove the part files only once the merged file is complete */
+	for (i = 0; i < nparts; i++)
+		unlink(parts[i]);
+
+	return 0;
+}
+
+static int append_part(int fdout, int fdin)
+{
+	char *buf = NULL;
+	ssize_t nr = 0;
+	ssize_t nw = 0;
+	ssize_t off = 0;
+
+	/* Let the kernel copy the bytes if it can */
+	while ((nr = copy_file_range(fdin, NULL, fdout, NULL, BUFLEN * 64, 0)) > 0);
+	if (nr == 0)
+		return 0;
+	if (errno != EXDEV && errno != EINVAL && errno != ENOSYS && errno != EOPNOTSUPP)
+		return 1;
+
+	/* Otherwise copy the rest through a user space buffer */
+	buf = malloc(BUFLEN);
+	if (UNLIKELY(!buf))
+		return 1;
+	while ((nr = read(fdin, buf, BUFLEN)) > 0)
+	{
+		for (off = 0; off < nr; off += nw)
+		{
+			nw = write(fdout, buf + off, nr - off);
+			if (nw < 0)
+			{
+				free(buf);
+				return 1;
+			}
+		}
+	}
+	free(buf);
+	return nr < 0;
+}
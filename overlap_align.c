@@ -0,0 +1,186 @@
+/* file: overlap_align.c
+ * description: Banded alignment of the overlapping ends of the query and the target
+ * author: Daniel Garrigan Lummei Analytics LLC
+ * updated: November 2016
+ * email: dgarriga@lummei.net
+ * copyright: MIT license
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "ddradseq.h"
+
+/* Score of the cells no path reaches */
+#define NEG_INF (-0x3fffffff)
+
+/* Define alphabet size */
+#define ALPHA_SIZE 5
+
+extern const ALIGN_RESULT g_defr;
+
+/* Function prototypes */
+static int align_diagonal(ALIGN_CTX *ctx, int d, int qlen, const char *query, int tlen,
+                          const char *target, const char *mat, int sa, int gapo, int gape,
+                          int band, int cut, int *qe, int *te);
+
+ALIGN_RESULT overlap_align(ALIGN_CTX *ctx, int qlen, const char *query, int tlen,
+                           const char *target, const char *mat, int gapo, int gape, int band,
+                           int minsc)
+{
+	int d = 0;
+	int i = 0;
+	int sa = 0;
+	int sc = 0;
+	int qe = 0;
+	int te = 0;
+	int cut = 0;
+	int bound = 0;
+	ALIGN_RESULT r;
+
+	r = g_defr;
+	r.score = 0;
+	for (i = 0; i < ALPHA_SIZE * ALPHA_SIZE; i++)
+		if (mat[i] > sa)
+			sa = mat[i];
+
+	/* Every alignment begins with the first base of the target against */
+	/* query position d, or, for negative d, with the first base of the */
+	/* query against target position -d; as the overlap can hold no more */
+	/* than min(qlen - d, tlen) or min(qlen, tlen + d) matches, the */
+	/* offsets on either side can be passed over once one of them */
+	/* scores above that bound; offsets are tried from zero outwards, */
+	/* the negative ones first, so a tie does not trim */
+	for (d = 0; d > -tlen; d--)
+	{
+		cut = r.score >= minsc ? r.score : minsc - 1;
+		bound = sa * (qlen < tlen + d ? qlen : tlen + d);
+		if (bound <= cut)
+			break;
+		sc = align_diagonal(ctx, d, qlen, query, tlen, target, mat, sa, gapo, gape, band, cut,
+		                    &qe, &te);
+		if (sc > cut)
+		{
+			r.score = sc;
+			r.query_begin = 0;
+			r.target_begin = -d;
+			r.query_end = qe;
+			r.target_end = te;
+		}
+	}
+	for (d = 1; d < qlen; d++)
+	{
+		cut = r.score >= minsc ? r.score : minsc - 1;
+		bound = sa * (qlen - d < tlen ? qlen - d : tlen);
+		if (bound <= cut)
+			break;
+		sc = align_diagonal(ctx, d, qlen, query, tlen, target, mat, sa, gapo, gape, band, cut,
+		                    &qe, &te);
+		if (sc > cut)
+		{
+			r.score = sc;
+			r.query_begin = d;
+			r.target_begin = 0;
+			r.query_end = qe;
+			r.target_end = te;
+		}
+	}
+
+	return r;
+}
+
+static int align_diagonal(ALIGN_CTX *ctx, int d, int qlen, const char *query, int tlen,
+                          const char *target, const char *mat, int sa, int gapo, int gape,
+                          int band, int cut, int *qe, int *te)
+{
+	int i = 0;
+	int j = 0;
+	int k = 0;
+	int i0 = d < 0 ? -d : 0;
+	int h = 0;
+	int e = 0;
+	int f = 0;
+	int rmax = 0;
+	int rest = 0;
+	int best = NEG_INF;
+	const int w = 2 * band + 1;
+	const int gapoe = gapo + gape;
+	int *H0 = ctx->band;
+	int *E0 = H0 + w;
+	int *H1 = E0 + w;
+	int *E1 = H1 + w;
+	int *tmp = NULL;
+	const char *ma = NULL;
+
+	/* Row i holds the query positions i + d - band to i + d + band, */
+	/* so the cell above is one slot to the right and the diagonal */
+	/* predecessor is in the same slot of the previous row */
+	for (i = i0; i < tlen; i++)
+	{
+		ma = mat + target[i] * ALPHA_SIZE;
+		rmax = NEG_INF;
+		f = NEG_INF;
+		for (k = 0; k < w; k++)
+		{
+			j = i + d - band + k;
+			if (j < 0 || j >= qlen)
+			{
+				H1[k] = NEG_INF;
+				E1[k] = NEG_INF;
+				f = NEG_INF;
+				continue;
+			}
+
+			/* The only path into the first row starts on the diagonal */
+			if (i == i0)
+			{
+				h = k == band ? ma[(unsigned char)query[j]] : NEG_INF;
+				e = NEG_INF;
+			}
+			else
+			{
+				h = H0[k] > NEG_INF ? H0[k] + ma[(unsigned char)query[j]] : NEG_INF;
+				e = NEG_INF;
+				if (k + 1 < w)
+				{
+					e = E0[k+1] - gape;
+					if (H0[k+1] - gapoe > e)
+						e = H0[k+1] - gapoe;
+				}
+			}
+			if (e > h)
+				h = e;
+			if (f > h)
+				h = f;
+			if (h < NEG_INF)
+				h = NEG_INF;
+			H1[k] = h;
+			E1[k] = e < NEG_INF ? NEG_INF : e;
+			if (h > best)
+			{
+				best = h;
+				*qe = j;
+				*te = i;
+			}
+			if (h > rmax)
+				rmax = h;
+			f -= gape;
+			if (h - gapoe > f)
+				f = h - gapoe;
+			if (f < NEG_INF)
+				f = NEG_INF;
+		}
+
+		/* Stop once no later cell can beat the best score so far */
+		rest = sa * (tlen - 1 - i);
+		if (rmax == NEG_INF || rmax + rest <= (best > cut ? best : cut))
+			break;
+		tmp = H0;
+		H0 = H1;
+		H1 = tmp;
+		tmp = E0;
+		E0 = E1;
+		E1 = tmp;
+	}
+
+	return best;
+}
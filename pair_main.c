@@ -9,15 +9,30 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/sysinfo.h>
 #include "ddradseq.h"
 
+/* Function prototypes */
+static int task_cmp(const void *a, const void *b);
+static void *pair_worker(void *arg);
+
 int pair_main(const CMD *cp)
 {
 	char *pch = NULL;
 	char **filelist = NULL;
 	int ret = 0;
 	unsigned int i = 0;
+	unsigned int t = 0;
 	unsigned int nfiles = 0;
+	unsigned int nworkers = 0;
+	size_t spn = 0;
+	struct stat st;
+	struct sysinfo si;
+	pthread_t *tid = NULL;
+	PAIRTASK *task = NULL;
+	PAIRPOOL pp;
 	FILE *lf = cp->lf;
 
 	/* Get list of all files */
@@ -31,63 +46,121 @@ int pair_main(const CMD *cp)
 		return 1;
 	}
 
+	/* Files are taken two at a time, so a file without its mate */
+	/* would leave the last task half filled */
+	if (nfiles % 2u)
+	{
+		logerror(lf, "%s:%d Found %u fastQ files; every forward file needs its reverse "
+		         "mate.\n", __func__, __LINE__, nfiles);
+		return 1;
+	}
+
+	task = calloc(nfiles / 2u, sizeof(PAIRTASK));
+	if (UNLIKELY(!task))
+	{
+		logerror(lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
+		return 1;
+	}
+
+	/* Each pair of files is one task */
 	for (i = 0; i < nfiles; i += 2)
 	{
-		khash_t(fastq) *h = NULL;
-		char *ffor = NULL;
-		char *frev = NULL;
-		size_t spn = 0;
+		PAIRTASK *pt = &task[t++];
 
 		/* Construct output file names */
-		ffor = strdup(filelist[i]);
-		if (UNLIKELY(!ffor))
+		pt->fin = filelist[i];
+		pt->rin = filelist[i+1];
+		pt->ffor = strdup(filelist[i]);
+		if (UNLIKELY(!pt->ffor))
 		{
 			logerror(lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
 			return 1;
 		}
-		frev = strdup(filelist[i+1]);
-		if (UNLIKELY(!frev))
+		pt->frev = strdup(filelist[i+1]);
+		if (UNLIKELY(!pt->frev))
 		{
 			logerror(lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
 			return 1;
 		}
-		pch = strstr(ffor, "parse");
+		pch = strstr(pt->ffor, "parse");
 		if (!pch)
 			return 1;
 		strncpy(pch, "pairs", DNAME_LENGTH);
-		pch = strstr(frev, "parse");
+		pch = strstr(pt->frev, "parse");
 		if (!pch)
 			return 1;
 		strncpy(pch, "pairs", DNAME_LENGTH);
 
 		/* Double-check that files are mates */
-		spn = strcspn(ffor, ".");
-		ret = strncmp(ffor, frev, spn);
+		spn = strcspn(pt->ffor, ".");
+		ret = strncmp(pt->ffor, pt->frev, spn);
 		if (ret)
 		{
 			logerror(lf, "%s:%d Files \'%s\' and \'%s\' do not appear to be mate-"
-				     "pairs.\n", __func__, __LINE__, ffor, frev);
+				     "pairs.\n", __func__, __LINE__, pt->ffor, pt->frev);
 			return 1;
 		}
 
-		/* Read forward fastQ file into hash table */
-		h = fastq_to_db(filelist[i], lf);
-		if (!h)
-			return 1;
+		/* Out of order mates hold the whole forward file, */
+		/* which expands to about four times its compressed size */
+		if (stat(pt->fin, &st) == 0)
+		{
+			pt->size = st.st_size;
+			pt->mem = 4u * (size_t)st.st_size;
+		}
+		if (stat(pt->rin, &st) == 0)
+			pt->size += st.st_size;
+		if (cp->pair_mem && pt->mem > ((size_t)cp->pair_mem << 20))
+			pt->mem = (size_t)cp->pair_mem << 20;
+	}
 
-		/* Print informational update to log file */
-		loginfo(lf, "Attempting to pair files \'%s\' and \'%s\'.\n", ffor, frev);
+	/* The largest samples go first, so that none is left running alone at the end */
+	qsort(task, t, sizeof(PAIRTASK), task_cmp);
 
-		/* Align mated pairs and write to output file*/
-		ret = pair_mates(filelist[i + 1], h, ffor, frev, lf);
-		if (ret)
+	/* Samples are paired concurrently within half of the free memory */
+	memset(&pp, 0, sizeof(PAIRPOOL));
+	pp.cp = cp;
+	pp.task = task;
+	pp.ntasks = t;
+	nworkers = cp->nthreads < 1 ? 1u : (unsigned int)cp->nthreads;
+	if (nworkers > t)
+		nworkers = t;
+	pp.wthreads = cp->nthreads / (int)nworkers > 1 ? cp->nthreads / (int)nworkers : 1;
+	sysinfo(&si);
+	pp.budget = ((size_t)si.freeram + (size_t)si.bufferram) * si.mem_unit / 2u;
+	pthread_mutex_init(&pp.lock, NULL);
+	pthread_cond_init(&pp.cond, NULL);
+	if (nworkers > 1)
+	{
+		loginfo(lf, "Pairing %u samples with %u threads.\n", t, nworkers);
+		tid = malloc(nworkers * sizeof(pthread_t));
+		if (UNLIKELY(!tid))
+		{
+			logerror(lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
 			return 1;
-
-		/* Free allocated memory */
-		free(ffor);
-		free(frev);
-		free_pairdb(h);
+		}
+		for (i = 0; i < nworkers; i++)
+		{
+			if (pthread_create(&tid[i], NULL, pair_worker, &pp))
+			{
+				logerror(lf, "%s:%d Failed to start pairing thread.\n", __func__, __LINE__);
+				pthread_mutex_lock(&pp.lock);
+				pp.failed = true;
+				pthread_mutex_unlock(&pp.lock);
+				nworkers = i;
+				break;
+			}
+		}
+		for (i = 0; i < nworkers; i++)
+			pthread_join(tid[i], NULL);
+		free(tid);
 	}
+	else
+		pair_worker(&pp);
+	pthread_cond_destroy(&pp.cond);
+	pthread_mutex_destroy(&pp.lock);
+	if (pp.failed)
+		return 1;
 
 	/* Print informational message to logfile */
 	if (string_equal(cp->mode, "pair"))
@@ -96,9 +169,97 @@ int pair_main(const CMD *cp)
 		loginfo(lf, "Done pairing all fastQ files in \'%s\'.\n", cp->outdir);
 
 	/* Deallocate memory */
+	for (i = 0; i < t; i++)
+	{
+		free(task[i].ffor);
+		free(task[i].frev);
+	}
+	free(task);
 	for (i = 0; i < nfiles; i++)
 		free(filelist[i]);
 	free(filelist);
 
 	return 0;
 }
+
+static int task_cmp(const void *a, const void *b)
+{
+	const PAIRTASK *ta = (const PAIRTASK*)a;
+	const PAIRTASK *tb = (const PAIRTASK*)b;
+
+	if (ta->size != tb->size)
+		return ta->size < tb->size ? 1 : -1;
+	return strcmp(ta->fin, tb->fin);
+}
+
+static void *pair_worker(void *arg)
+{
+	int ret = 0;
+	unsigned int i = 0;
+	PAIRPOOL *pp = (PAIRPOOL*)arg;
+	PAIRTASK *pt = NULL;
+	PAIRTASK *next = NULL;
+	char *nextfiles[2];
+	const CMD *cp = pp->cp;
+	bool pending = false;
+
+	pthread_mutex_lock(&pp->lock);
+	while (!pp->failed)
+	{
+		/* Take the largest waiting task that fits in the memory budget; */
+		/* a task always runs when no other is in progress */
+		pt = NULL;
+		next = NULL;
+		pending = false;
+		for (i = 0; i < pp->ntasks; i++)
+		{
+			if (pp->task[i].taken)
+				continue;
+			pending = true;
+			if (pt)
+			{
+				next = &pp->task[i];
+				break;
+			}
+			if (pp->running == 0 || pp->used + pp->task[i].mem <= pp->budget)
+				pt = &pp->task[i];
+		}
+		if (!pending)
+			break;
+		if (!pt)
+		{
+			pthread_cond_wait(&pp->cond, &pp->lock);
+			continue;
+		}
+		pt->taken = true;
+		pp->used += pt->mem;
+		pp->running++;
+		pthread_mutex_unlock(&pp->lock);
+
+		/* Start reading the next task while this one is processed */
+		if (next)
+		{
+			nextfiles[0] = next->fin;
+			nextfiles[1] = next->rin;
+			prefetch(cp, nextfiles, 2);
+		}
+
+		/* Print informational update to log file */
+		loginfo(cp->lf, "Attempting to pair files \'%s\' and \'%s\'.\n", pt->ffor, pt->frev);
+
+		/* Align mated pairs and write to output file*/
+		ret = pair_mates(cp, pt->fin, pt->rin, pt->ffor, pt->frev, pp->wthreads);
+
+		pthread_mutex_lock(&pp->lock);
+		pp->used -= pt->mem;
+		pp->running--;
+		if (ret)
+			pp->failed = true;
+		pthread_cond_broadcast(&pp->cond);
+	}
+	pthread_mutex_unlock(&pp->lock);
+	compress_free();
+	write_block_free();
+
+	return NULL;
+}
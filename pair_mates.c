@@ -10,161 +10,184 @@
 #include <stdlib.h>
 #include <stddef.h>
 #include <string.h>
-#include <zlib.h>
-#include <errno.h>
 #include "ddradseq.h"
 #include "khash.h"
 
-extern int errno;
+/* Number of forward entries read ahead of their mates before the whole */
+/* forward file is held in memory instead; a memory budget may stop the */
+/* window sooner */
+#define PAIR_WINDOW 65536
 
-int pair_mates(const char *filename, const khash_t(fastq) *h, const char *ffor,
-               const char *frev, FILE *lf)
+int pair_mates(const CMD *cp, const char *fin, const char *rin, const char *ffor,
+               const char *frev, int nthreads)
 {
-	char **buf = NULL;
-	char *idline = NULL;
-	char *mkey = NULL;
-	char *pstart = NULL;
-	char *pend = NULL;
-	char *errstr = NULL;
-	int i = 0;
-	size_t l = 0;
-	size_t lc = 0;
-	size_t pos = 0;
-	size_t strl = 0;
-	ptrdiff_t plen = 0;
+	char *key = NULL;
+	char *tmp = NULL;
+	const char *fkey = NULL;
+	const char *rkey = NULL;
+	bool whole = false;
+	bool found = false;
+	int ret = 0;
+	int fret = 0;
+	size_t fklen = 0;
+	size_t rklen = 0;
+	size_t kcap = 0;
+	size_t nwin = 0;
+	size_t budget = (size_t)cp->pair_mem << 20;
 	khint_t k = 0;
-	gzFile in;
-	gzFile fout;
-	gzFile rout;
-	FASTQ *e = NULL;
-
-	/* Allocate memory for buffer from heap */
-	buf = malloc(BSIZE * sizeof(char*));
-	if (UNLIKELY(!buf))
-	{
-		logerror(lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
+	FQREC frec;
+	FQREC rrec;
+	READER *fr = NULL;
+	READER *rr = NULL;
+	WRITER *fout = NULL;
+	WRITER *rout = NULL;
+	PAIRDB *db = NULL;
+	FILE *lf = cp->lf;
+
+	/* Open the fastQ input streams */
+	fr = reader_open(fin, lf);
+	if (!fr)
 		return 1;
-	}
-	for (i = 0; i < BSIZE; i++)
-	{
-		buf[i] = malloc(MAX_LINE_LENGTH);
-		if (UNLIKELY(!buf[i]))
-		{
-			logerror(lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
-			return 1;
-		}
-	}
-
-	/* Open the fastQ input stream */
-	in = gzopen(filename, "rb");
-	if (!in)
-	{
-		errstr = strerror(errno);
-		logerror(lf, "%s:%d Unable to open input file \'%s\': %s.\n", __func__, __LINE__,
-		         filename, errstr);
+	rr = reader_open(rin, lf);
+	if (!rr)
 		return 1;
-	}
 
 	/* Open the output fastQ file streams */
-	fout = gzopen(ffor, "wb");
+	fout = writer_open(ffor, cp->pair_level, nthreads, lf);
 	if (!fout)
-	{
-		errstr = strerror(errno);
-		logerror(lf, "%s:%d Unable to forward output file \'%s\': %s.\n", __func__,
-		         __LINE__, ffor, errstr);
 		return 1;
-	}
 
-	rout = gzopen(frev, "wb");
+	rout = writer_open(frev, cp->pair_level, nthreads, lf);
 	if (!rout)
-	{
-		errstr = strerror(errno);
-		logerror(lf, "%s:%d Unable to reverse output file \'%s\': %s.\n", __func__,
-		         __LINE__, frev, errstr);
 		return 1;
-	}
 
-	/* Enter data from the fastQ input file into the database */
-	while (1)
+	/* Forward entries read ahead of their mates */
+	db = init_pairdb(lf);
+	if (!db)
+		return 1;
+
+	/* The parse stage writes mates in the same order, so the mate of each */
+	/* reverse entry is normally the next forward entry; forward entries */
+	/* read past are held in a window until their mates turn up */
+	while ((ret = reader_next(rr, &rrec)) > 0)
 	{
-		/* Fill up the buffer */
-		for (lc = 0; lc < BSIZE; lc++)
-		{
-			/* Clear the buffer */
-			memset(buf[lc], 0, MAX_LINE_LENGTH);
+		if (mate_key(&rrec, &rkey, &rklen, lf))
+			return 1;
 
-			/* Get line from the fastQ input stream */
-			if (gzgets(in, buf[lc], MAX_LINE_LENGTH) == Z_NULL)
-				break;
+		/* Hash lookups need a NUL-terminated copy of the key */
+		if (rklen >= kcap)
+		{
+			tmp = realloc(key, rklen + 1u);
+			if (UNLIKELY(!tmp))
+			{
+				logerror(lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
+				return 1;
+			}
+			key = tmp;
+			kcap = rklen + 1u;
 		}
+		memcpy(key, rkey, rklen);
+		key[rklen] = '\0';
 
-		/* Iterate through lines in the buffer */
-		for (l = 0; l < lc; l++)
+		/* Look for the mate among the forward entries held so far */
+		if (kh_size(db->h) > 0)
 		{
-			/* We are at the end of one fastQ entry */
-			if (l % 4 == 3)
+			k = kh_get(fastq, db->h, key);
+			if (k != kh_end(db->h))
 			{
-				/* Parse entry identifier */
-				pos = strcspn(buf[l-3], "\n");
-				buf[l-3][pos] = '\0';
-				strl = strlen(&buf[l-3][1]);
-
-				/* Construct fastQ hash key */
-				idline = malloc(strl + 1u);
-				if (UNLIKELY(!idline))
-				{
-					logerror(lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
-					return 1;
-				}
-				strcpy(idline, &buf[l-3][1]);
-
-				/* Parse Illumina identifier line and construct hash key */
-				pstart = strchr(idline, ':');
-				pend = strchr(idline, ' ');
-				plen = pend - pstart;
-				mkey = strndup(pstart+1, plen - 1);
-				if (UNLIKELY(!mkey))
-				{
-					logerror(lf, "%s:%d fastQ header parsing error.\n", __func__, __LINE__);
+				if (write_pair(fout, rout, kh_value(db->h, k), NULL, &rrec, lf))
 					return 1;
-				}
-				k = kh_get(fastq, h, mkey);
-				if (k != kh_end(h))
-					e = kh_value(h, k);
-				free(mkey);
-				free(idline);
 
-				if (e != NULL)
+				/* The window is emptied as soon as all its entries are paired */
+				if (!whole)
 				{
-					/* Parse DNA sequence */
-					pos = strcspn(buf[l-2], "\n");
-					buf[l-2][pos] = '\0';
-
-					/* Parse quality sequence */
-					pos = strcspn(buf[l], "\n");
-					buf[l][pos] = '\0';
-
-					/* Need to construct output file streams */
-					gzprintf(fout, "@%s\n%s\n+\n%s\n", e->id, e->seq, e->qual);
-					gzprintf(rout, "@%s\n%s\n+\n%s\n", &buf[l-3][1], &buf[l-2][0], &buf[l][0]);
+					kh_del(fastq, db->h, k);
+					if (kh_size(db->h) == 0)
+					{
+						arena_reset(db->arena);
+						nwin = 0;
+					}
 				}
+				continue;
 			}
 		}
+		if (whole)
+			continue;
+
+		/* Read ahead in the forward file until the mate turns up */
+		found = false;
+		while (nwin < PAIR_WINDOW && (!budget || db->arena->nbytes <= budget) &&
+		       (fret = reader_next(fr, &frec)) > 0)
+		{
+			if (mate_key(&frec, &fkey, &fklen, lf))
+				return 1;
+			if (fklen == rklen && memcmp(fkey, rkey, rklen) == 0)
+			{
+				if (write_pair(fout, rout, NULL, &frec, &rrec, lf))
+					return 1;
+				found = true;
+				break;
+			}
+			if (add_pairdb(db, &frec, fkey, fklen))
+				return 1;
+			nwin++;
+		}
+		if (fret < 0)
+			return 1;
+		if (found)
+			continue;
+
+		/* Every forward entry is now held, and this one has no mate */
+		if (fret == 0)
+		{
+			loginfo(lf, "Mates in \'%s\' and \'%s\' are out of order; holding all forward "
+			        "entries in memory.\n", fin, rin);
+			whole = true;
+			continue;
+		}
 
-		/* If we are at the end of the file */
-		if (lc < BSIZE)
+		/* The window overflowed-- hold the rest of the forward file, */
+		/* unless it exceeds the memory budget */
+		loginfo(lf, "Mates in \'%s\' and \'%s\' are out of order; holding all forward "
+		        "entries in memory.\n", fin, rin);
+		while ((fret = reader_next(fr, &frec)) > 0)
+		{
+			if (mate_key(&frec, &fkey, &fklen, lf))
+				return 1;
+			if (add_pairdb(db, &frec, fkey, fklen))
+				return 1;
+			if (budget && db->arena->nbytes > budget)
+				break;
+		}
+		if (fret < 0)
+			return 1;
+		if (fret > 0)
+		{
+			if (pair_sorted(cp, db, fr, rr, &rrec, fout, rout, ffor))
+				return 1;
 			break;
+		}
+		whole = true;
+		k = kh_get(fastq, db->h, key);
+		if (k != kh_end(db->h) && write_pair(fout, rout, kh_value(db->h, k), NULL, &rrec, lf))
+			return 1;
 	}
+	if (ret < 0)
+		return 1;
 
-	/* Free memory for buffer to heap */
-	for (i = 0; i < BSIZE; i++)
-		free(buf[i]);
-	free(buf);
-
-	/* Close input stream */
-	gzclose(in);
-	gzclose(fout);
-	gzclose(rout);
+	/* Close input streams */
+	free(key);
+	free_pairdb(db);
+	reader_close(fr);
+	reader_close(rr);
+	ret = writer_close(fout);
+	ret |= writer_close(rout);
+	if (ret)
+	{
+		logerror(lf, "%s:%d Problem writing output files \'%s\' and \'%s\'.\n", __func__,
+		         __LINE__, ffor, frev);
+		return 1;
+	}
 
 	return 0;
 }
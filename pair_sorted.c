@@ -0,0 +1,317 @@
+/* file: pair_sorted.c
+ * description: Pairs mates by an external sort-merge when they do not fit the memory budget
+ * author: Daniel Garrigan Lummei Analytics LLC
+ * updated: November 2016
+ * email: dgarriga@lummei.net
+ * copyright: MIT license
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include "khash.h"
+#include "ddradseq.h"
+
+extern int errno;
+
+/* Function prototypes */
+static uint64_t pack_coord(const char *key, size_t klen);
+static int key_cmp(const SORTREC *a, const SORTREC *b);
+static int sortrec_cmp(const void *a, const void *b);
+static size_t pairdb_bytes(const PAIRDB *db);
+static int fill_runs(const CMD *cp, PAIRDB *db, READER *in, const char *outfile, RUNSET *rs);
+static int spill_run(PAIRDB *db, const char *outfile, RUNSET *rs);
+static int runset_advance(RUNSET *rs, size_t i);
+static long runset_min(const RUNSET *rs);
+static void runset_close(RUNSET *rs);
+
+int pair_sorted(const CMD *cp, PAIRDB *db, READER *fr, READER *rr, const FQREC *rrec,
+                WRITER *fout, WRITER *rout, const char *ffor)
+{
+	const char *key = NULL;
+	int c = 0;
+	long fi = 0;
+	long ri = 0;
+	size_t klen = 0;
+	RUNSET fruns;
+	RUNSET rruns;
+	FILE *lf = cp->lf;
+
+	memset(&fruns, 0, sizeof(RUNSET));
+	memset(&rruns, 0, sizeof(RUNSET));
+	fruns.lf = lf;
+	rruns.lf = lf;
+	loginfo(lf, "Forward entries for \'%s\' exceed %d Mb; pairing by external sort.\n",
+	        ffor, cp->pair_mem);
+
+	/* Sort the forward entries, beginning with those already held, into runs */
+	if (fill_runs(cp, db, fr, ffor, &fruns))
+		return 1;
+
+	/* Then the reverse entries, beginning with the one that has not been paired yet */
+	if (mate_key(rrec, &key, &klen, lf) || add_pairdb(db, rrec, key, klen))
+		return 1;
+	if (fill_runs(cp, db, rr, ffor, &rruns))
+		return 1;
+	loginfo(lf, "Merging %zu forward and %zu reverse runs for \'%s\'.\n", fruns.n, rruns.n, ffor);
+
+	/* Both sides now come out in key order, so mates meet at the run heads */
+	fi = runset_min(&fruns);
+	ri = runset_min(&rruns);
+	while (fi >= 0 && ri >= 0)
+	{
+		c = key_cmp(&fruns.head[fi], &rruns.head[ri]);
+		if (c < 0)
+		{
+			if (runset_advance(&fruns, fi))
+				return 1;
+			fi = runset_min(&fruns);
+		}
+		else
+		{
+			if (c == 0 && write_pair(fout, rout, NULL, &fruns.rec[fi], &rruns.rec[ri], lf))
+				return 1;
+			if (runset_advance(&rruns, ri))
+				return 1;
+			ri = runset_min(&rruns);
+		}
+	}
+
+	runset_close(&fruns);
+	runset_close(&rruns);
+
+	return 0;
+}
+
+static uint64_t pack_coord(const char *key, size_t klen)
+{
+	const char *p = key + klen;
+	int f = 0;
+	uint64_t x = 0;
+	uint64_t m = 1;
+	uint64_t v[4] = {0, 0, 0, 0};
+
+	/* The key ends in the lane, tile, x and y fields, which are read backwards */
+	for (f = 0; f < 4; f++)
+	{
+		x = 0;
+		m = 1;
+		while (p > key && p[-1] >= '0' && p[-1] <= '9')
+		{
+			x += (uint64_t)(p[-1] - '0') * m;
+			m *= 10;
+			p--;
+		}
+		v[f] = x;
+		if (p == key || p[-1] != ':')
+			break;
+		p--;
+	}
+
+	return (v[3] & 0xff) << 56 | (v[2] & 0xffff) << 40 | (v[1] & 0xfffff) << 20 | (v[0] & 0xfffff);
+}
+
+static int key_cmp(const SORTREC *a, const SORTREC *b)
+{
+	int c = 0;
+
+	/* Packed coordinates decide almost every comparison; */
+	/* the whole key breaks ties, so the order is total */
+	if (a->coord != b->coord)
+		return a->coord < b->coord ? -1 : 1;
+	c = memcmp(a->key, b->key, a->klen < b->klen ? a->klen : b->klen);
+	if (c)
+		return c;
+	return (a->klen > b->klen) - (a->klen < b->klen);
+}
+
+static int sortrec_cmp(const void *a, const void *b)
+{
+	return key_cmp((const SORTREC*)a, (const SORTREC*)b);
+}
+
+static size_t pairdb_bytes(const PAIRDB *db)
+{
+	const ARENA *a = db->arena;
+
+	return a->nbytes - a->size + a->used + kh_n_buckets(db->h) * (sizeof(char*) + sizeof(FASTQ*) + 1u);
+}
+
+static int fill_runs(const CMD *cp, PAIRDB *db, READER *in, const char *outfile, RUNSET *rs)
+{
+	const char *key = NULL;
+	int ret = 0;
+	size_t klen = 0;
+	size_t budget = (size_t)cp->pair_mem << 20;
+	FQREC rec;
+
+	/* Entries are spilled to a run whenever the held entries reach the budget */
+	while (1)
+	{
+		if (pairdb_bytes(db) >= budget && spill_run(db, outfile, rs))
+			return 1;
+		ret = reader_next(in, &rec);
+		if (ret <= 0)
+			break;
+		if (mate_key(&rec, &key, &klen, rs->lf) || add_pairdb(db, &rec, key, klen))
+			return 1;
+	}
+	if (ret < 0)
+		return 1;
+
+	return spill_run(db, outfile, rs);
+}
+
+static int spill_run(PAIRDB *db, const char *outfile, RUNSET *rs)
+{
+	char *runfile = NULL;
+	char *errstr = NULL;
+	const char *seq = NULL;
+	int fd = 0;
+	size_t i = 0;
+	size_t n = kh_size(db->h);
+	khint_t k = 0;
+	void *tmp = NULL;
+	const FASTQ *e = NULL;
+	SORTREC *recs = NULL;
+	READER *r = NULL;
+	FILE *fp = NULL;
+	FILE *lf = rs->lf;
+
+	if (n == 0)
+		return 0;
+
+	/* Sort the held entries by key */
+	recs = malloc(n * sizeof(SORTREC));
+	if (UNLIKELY(!recs))
+	{
+		logerror(lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
+		return 1;
+	}
+	for (k = kh_begin(db->h); k != kh_end(db->h); k++)
+	{
+		if (kh_exist(db->h, k))
+		{
+			recs[i].key = kh_key(db->h, k);
+			recs[i].klen = strlen(recs[i].key);
+			recs[i].coord = pack_coord(recs[i].key, recs[i].klen);
+			recs[i].e = kh_value(db->h, k);
+			i++;
+		}
+	}
+	qsort(recs, n, sizeof(SORTREC), sortrec_cmp);
+
+	/* Write them to an uncompressed run file next to the output file */
+	runfile = malloc(strlen(outfile) + 11u);
+	if (UNLIKELY(!runfile))
+	{
+		logerror(lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
+		return 1;
+	}
+	sprintf(runfile, "%s.runXXXXXX", outfile);
+	fd = mkstemp(runfile);
+	fp = fd < 0 ? NULL : fdopen(fd, "w");
+	if (!fp)
+	{
+		errstr = strerror(errno);
+		logerror(lf, "%s:%d Unable to create sort run file \'%s\': %s.\n", __func__, __LINE__,
+		         runfile, errstr);
+		return 1;
+	}
+	for (i = 0; i < n; i++)
+	{
+		e = recs[i].e;
+		seq = e->text + e->idlen + 1;
+		fprintf(fp, "@%s\n%s\n+\n%s\n", e->text, seq, seq + e->seqlen + 1);
+	}
+	free(recs);
+	if (ferror(fp) | fclose(fp))
+	{
+		logerror(lf, "%s:%d Problem writing sort run file \'%s\'.\n", __func__, __LINE__, runfile);
+		unlink(runfile);
+		return 1;
+	}
+
+	/* The run is read back from a mapping, so its name can go at once */
+	r = reader_open(runfile, lf);
+	unlink(runfile);
+	free(runfile);
+	if (!r)
+		return 1;
+	tmp = realloc(rs->run, (rs->n + 1u) * sizeof(READER*));
+	if (tmp)
+		rs->run = tmp;
+	tmp = tmp ? realloc(rs->rec, (rs->n + 1u) * sizeof(FQREC)) : NULL;
+	if (tmp)
+		rs->rec = tmp;
+	tmp = tmp ? realloc(rs->head, (rs->n + 1u) * sizeof(SORTREC)) : NULL;
+	if (UNLIKELY(!tmp))
+	{
+		logerror(lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
+		reader_close(r);
+		return 1;
+	}
+	rs->head = tmp;
+	rs->run[rs->n] = r;
+	rs->n++;
+
+	/* Release the held entries for the next run; the table is made */
+	/* anew, as clearing it would keep the buckets of the largest run */
+	kh_destroy(fastq, db->h);
+	db->h = kh_init(fastq);
+	if (UNLIKELY(!db->h))
+	{
+		logerror(lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
+		return 1;
+	}
+	arena_reset(db->arena);
+
+	return runset_advance(rs, rs->n - 1u);
+}
+
+static int runset_advance(RUNSET *rs, size_t i)
+{
+	int ret = 0;
+	SORTREC *h = &rs->head[i];
+
+	ret = reader_next(rs->run[i], &rs->rec[i]);
+	if (ret < 0)
+		return 1;
+	if (ret == 0)
+	{
+		h->key = NULL;
+		return 0;
+	}
+	if (mate_key(&rs->rec[i], &h->key, &h->klen, rs->lf))
+		return 1;
+	h->coord = pack_coord(h->key, h->klen);
+	h->e = NULL;
+
+	return 0;
+}
+
+static long runset_min(const RUNSET *rs)
+{
+	long best = -1;
+	size_t i = 0;
+
+	/* Runs are few, so the smallest head is found by a linear scan */
+	for (i = 0; i < rs->n; i++)
+		if (rs->head[i].key && (best < 0 || key_cmp(&rs->head[i], &rs->head[best]) < 0))
+			best = (long)i;
+
+	return best;
+}
+
+static void runset_close(RUNSET *rs)
+{
+	size_t i = 0;
+
+	for (i = 0; i < rs->n; i++)
+		reader_close(rs->run[i]);
+	free(rs->run);
+	free(rs->rec);
+	free(rs->head);
+}
@@ -0,0 +1,160 @@
+/* file: parse_forward.c
+ * description: Parses a forward fastQ entry into its sample buffer
+ * author: Daniel Garrigan Lummei Analytics LLC
+ * updated: November 2016
+ * email: dgarriga@lummei.net
+ * copyright: MIT license
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "khash.h"
+#include "ddradseq.h"
+
+int parse_forward(const CMD *cp, const FQREC *rec, const khash_t(pool_hash) *h,
+                  khash_t(mates) *m)
+{
+	char *idline = NULL;
+	char *mkey = NULL;
+	char *pstart = NULL;
+	char *pend = NULL;
+	char *fstart = NULL;
+	char *fend = NULL;
+	char *index_sequence = NULL;
+	const char *flowcell = NULL;
+	char *barcode_sequence = NULL;
+	int a = 0;
+	int ret = 0;
+	const int dist = cp->dist;
+	khint_t i = 0;
+	khint_t j = 0;
+	khint_t k = 0;
+	khint_t kk = 0;
+	khint_t mk = 0;
+	khash_t(barcode) *b = NULL;
+	khash_t(pool) *p = NULL;
+	BARCODE *bc = NULL;
+	POOL *pl = NULL;
+	FILE *lf = cp->lf;
+
+	/* Make a copy of the Illumina identifier line */
+	idline = strndup(rec->id, rec->idlen);
+	if (UNLIKELY(!idline))
+	{
+		logerror(lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
+		return 1;
+	}
+
+	/* Parse Illumina identifier line and construct fastQ hash key */
+	pstart = strchr(idline, ':');
+	pend = strchr(idline, ' ');
+	fstart = pstart ? strchr(pstart + 1, ':') : NULL;
+	fend = fstart ? strchr(fstart + 1, ':') : NULL;
+	index_sequence = strrchr(idline, ':');
+	if (UNLIKELY(!pend || !fend || fend > pend))
+	{
+		logerror(lf, "%s:%d fastQ header parsing error.\n", __func__, __LINE__);
+		free(idline);
+		return 1;
+	}
+	mkey = strndup(pstart + 1, pend - pstart - 1);
+	if (UNLIKELY(!mkey))
+	{
+		logerror(lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
+		free(idline);
+		return 1;
+	}
+
+	/* Lookup flow cell identifier, unless it was given for the input */
+	*fend = '\0';
+	flowcell = cp->flowcell ? cp->flowcell : fstart + 1;
+	i = kh_get(pool_hash, h, flowcell);
+	if (i == kh_end(h))
+	{
+		logwarn(lf, "Hash lookup failure using key %s.\n", flowcell);
+		*fend = ':';
+		logwarn(lf, "Skipping sequence: @%s\n", idline);
+		free(mkey);
+		free(idline);
+		return 0;
+	}
+	p = kh_value(h, i);
+
+	/* Lookup pool identifier */
+	j = kh_get(pool, p, index_sequence + 1);
+	if (j == kh_end(p))
+	{
+		logerror(lf, "%s:%d Pool sequence %s not found in association with flow cell %s. "
+		         "Possible incomplete CSV database file.\n", __func__, __LINE__,
+		         index_sequence + 1, flowcell);
+		free(mkey);
+		free(idline);
+		return 1;
+	}
+	pl = kh_value(p, j);
+	b = pl->b;
+	free(idline);
+
+	/* Reads too short to hold a barcode are skipped */
+	if (rec->seqlen < pl->barcode_length || rec->quallen < pl->barcode_length)
+	{
+		free(mkey);
+		return 0;
+	}
+
+	/* Grab the barcode before trimming */
+	barcode_sequence = strndup(rec->seq, pl->barcode_length);
+	if (UNLIKELY(!barcode_sequence))
+	{
+		logerror(lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
+		free(mkey);
+		return 1;
+	}
+
+	/* Find the barcode in the database */
+	k = kh_get(barcode, b, barcode_sequence);
+	if (k != kh_end(b))
+		bc = kh_value(b, k);
+	else
+	{
+		/* Iterate through all barcode hash keys and */
+		/* calculate Levenshtein distance */
+		for (kk = kh_begin(b); kk != kh_end(b); kk++)
+		{
+			if (kh_exist(b, kk))
+			{
+				if (levenshtein(kh_key(b, kk), barcode_sequence) <= dist)
+				{
+					bc = kh_value(b, kk);
+					break;
+				}
+			}
+		}
+	}
+
+	/* If barcode still not found-- skip sequence */
+	if (!bc)
+	{
+		free(mkey);
+		free(barcode_sequence);
+		return 0;
+	}
+
+	/* Lookup key in mate pair hash, which takes over the barcode */
+	mk = kh_put(mates, m, mkey, &a);
+	if (a)
+		kh_value(m, mk) = barcode_sequence;
+	else
+	{
+		free(mkey);
+		free(barcode_sequence);
+	}
+
+	/* Add the entry with its barcode trimmed to the sample buffer */
+	ret = buffer_record(cp, FORWARD, bc, rec, pl->barcode_length);
+	if (ret)
+		return 1;
+
+	return 0;
+}
@@ -11,6 +11,10 @@
 #include <string.h>
 #include "ddradseq.h"
 
+/* Function prototypes */
+static int parse_pairs(const CMD *cp, char **filelist, unsigned int nfiles,
+                       khash_t(pool_hash) *h);
+
 int parse_main(const CMD *cp)
 {
 	char **filelist = NULL;
@@ -18,7 +22,6 @@ int parse_main(const CMD *cp)
 	unsigned int i = 0;
 	unsigned int nfiles = 0;
 	khash_t(pool_hash) *h = NULL;
-	khash_t(mates) *m = NULL;
 	FILE *lf = cp->lf;
 
 	/* Check the integrity of the CSV input database file */
@@ -44,10 +47,22 @@ int parse_main(const CMD *cp)
 	if (ret)
 		return 1;
 
-	/* Initialize hash for mate pair information */
-	m = kh_init(mates);
-	if (!m)
-		return 1;
+	/* Streams named on the command line are parsed in lockstep */
+	if (cp->r1)
+	{
+		if (cp->flowcell && kh_get(pool_hash, h, cp->flowcell) == kh_end(h))
+		{
+			logerror(lf, "%s:%d Flow cell %s is not in the CSV database file.\n",
+			         __func__, __LINE__, cp->flowcell);
+			return 1;
+		}
+		ret = parse_streams(cp, cp->r1, cp->r2, h);
+		if (ret)
+			return 1;
+		free_db(h);
+		loginfo(lf, "Parse step of pipeline is complete.\n");
+		return 0;
+	}
 
 	/* Get list of all files */
 	nfiles = traverse_dirtree(cp, __func__, &filelist);
@@ -60,6 +75,56 @@ int parse_main(const CMD *cp)
 		return 1;
 	}
 
+	/* Each interleaved file holds both mates of its pairs */
+	if (cp->interleaved)
+	{
+		for (i = 0; i < nfiles; i++)
+		{
+			if (i + 1 < nfiles)
+				prefetch(cp, filelist + i + 1, 1);
+			ret = parse_streams(cp, filelist[i], NULL, h);
+			if (ret)
+				return 1;
+		}
+	}
+	else
+	{
+		ret = parse_pairs(cp, filelist, nfiles, h);
+		if (ret)
+			return 1;
+	}
+
+	/* Deallocate memory from the heap */
+	for (i = 0; i < nfiles; i++)
+		free(filelist[i]);
+	free(filelist);
+	free_db(h);
+
+	/* Print informational message to log */
+	loginfo(lf, "Parse step of pipeline is complete.\n");
+
+	return 0;
+}
+
+static int parse_pairs(const CMD *cp, char **filelist, unsigned int nfiles,
+                       khash_t(pool_hash) *h)
+{
+	int ret = 0;
+	unsigned int i = 0;
+	khash_t(mates) *m = NULL;
+	FILE *lf = cp->lf;
+
+	if (nfiles % 2)
+	{
+		logerror(lf, "%s:%d Found an odd number of input fastQ files.\n", __func__, __LINE__);
+		return 1;
+	}
+
+	/* Initialize hash for mate pair information */
+	m = kh_init(mates);
+	if (!m)
+		return 1;
+
 	for (i = 0; i < nfiles; i += 2)
 	{
 		char *ffor = NULL;
@@ -91,6 +156,10 @@ int parse_main(const CMD *cp)
 		/* Print informational update to log file */
 		loginfo(lf, "Deciphering mate-pair information for \'%s\' and \'%s\'.\n", ffor, frev);
 
+		/* Start reading the next pair while this one is processed */
+		if (i + 2 < nfiles)
+			prefetch(cp, filelist + i + 2, 2);
+
 		/* Read the forward fastQ input file */
 		ret = parse_fastq(cp, FORWARD, ffor, h, m);
 		if (ret)
@@ -104,15 +173,7 @@ int parse_main(const CMD *cp)
 		free(frev);
 	}
 
-	/* Deallocate memory from the heap */
-	for (i = 0; i < nfiles; i++)
-		free(filelist[i]);
-	free(filelist);
-	free_db(h);
 	free_matedb(m);
 
-	/* Print informational message to log */
-	loginfo(lf, "Parse step of pipeline is complete.\n");
-
 	return 0;
 }
@@ -0,0 +1,113 @@
+/* file: parse_reverse.c
+ * description: Parses a reverse fastQ entry into the sample buffer of its mate
+ * author: Daniel Garrigan Lummei Analytics LLC
+ * updated: November 2016
+ * email: dgarriga@lummei.net
+ * copyright: MIT license
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "khash.h"
+#include "ddradseq.h"
+
+int parse_reverse(const CMD *cp, const FQREC *rec, const khash_t(pool_hash) *h,
+                  const khash_t(mates) *m)
+{
+	char *idline = NULL;
+	char *pstart = NULL;
+	char *pend = NULL;
+	char *fstart = NULL;
+	char *fend = NULL;
+	char *index_sequence = NULL;
+	const char *flowcell = NULL;
+	char *barcode_sequence = NULL;
+	int ret = 0;
+	khint_t i = 0;
+	khint_t j = 0;
+	khint_t k = 0;
+	khint_t mk = 0;
+	khash_t(barcode) *b = NULL;
+	khash_t(pool) *p = NULL;
+	BARCODE *bc = NULL;
+	POOL *pl = NULL;
+	FILE *lf = cp->lf;
+
+	/* Make a copy of the Illumina identifier line */
+	idline = strndup(rec->id, rec->idlen);
+	if (UNLIKELY(!idline))
+	{
+		logerror(lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
+		return 1;
+	}
+
+	/* Parse Illumina identifier line */
+	pstart = strchr(idline, ':');
+	pend = strchr(idline, ' ');
+	fstart = pstart ? strchr(pstart + 1, ':') : NULL;
+	fend = fstart ? strchr(fstart + 1, ':') : NULL;
+	index_sequence = strrchr(idline, ':');
+	if (UNLIKELY(!pend || !fend || fend > pend))
+	{
+		logerror(lf, "%s:%d fastQ header parsing error.\n", __func__, __LINE__);
+		free(idline);
+		return 1;
+	}
+
+	/* Lookup flow cell identifier, unless it was given for the input */
+	*fend = '\0';
+	flowcell = cp->flowcell ? cp->flowcell : fstart + 1;
+	i = kh_get(pool_hash, h, flowcell);
+	if (i == kh_end(h))
+	{
+		/* Flow cell identifier is not present in database */
+		logwarn(lf, "Hash lookup failure using key %s.\n", flowcell);
+		*fend = ':';
+		logwarn(lf, "Skipping sequence: @%s\n", idline);
+		free(idline);
+		return 0;
+	}
+	*fend = ':';
+	p = kh_value(h, i);
+
+	/* Lookup pool identifier */
+	j = kh_get(pool, p, index_sequence + 1);
+	if (j == kh_end(p))
+	{
+		logerror(lf, "%s:%d Pool sequence %s not found in association with flow cell. "
+		         "Possible incomplete CSV database file.\n", __func__, __LINE__,
+		         index_sequence + 1);
+		free(idline);
+		return 1;
+	}
+	pl = kh_value(p, j);
+	b = pl->b;
+
+	/* Retrieve barcode sequence of mate */
+	*pend = '\0';
+	mk = kh_get(mates, m, pstart + 1);
+	if (mk == kh_end(m))
+	{
+		logwarn(lf, "Hash lookup failure using key %s.\n", pstart + 1);
+		*pend = ' ';
+		logwarn(lf, "Skipping sequence: @%s\n", idline);
+		free(idline);
+		return 0;
+	}
+	free(idline);
+	barcode_sequence = kh_value(m, mk);
+
+	/* Get the barcode entry of read's mate */
+	k = kh_get(barcode, b, barcode_sequence);
+	if (k == kh_end(b))
+		return 0;
+	bc = kh_value(b, k);
+
+	/* Add the entry to the sample buffer */
+	ret = buffer_record(cp, REVERSE, bc, rec, 0);
+	if (ret)
+		return 1;
+
+	return 0;
+}
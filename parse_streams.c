@@ -0,0 +1,119 @@
+/* file: parse_streams.c
+ * description: Parses forward and reverse input streams, or one interleaved stream, in lockstep
+ * author: Daniel Garrigan Lummei Analytics LLC
+ * updated: November 2016
+ * email: dgarriga@lummei.net
+ * copyright: MIT license
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "khash.h"
+#include "ddradseq.h"
+
+/* Number of mate entries held before the mate hash is emptied */
+#define MATE_WINDOW 65536
+
+int parse_streams(const CMD *cp, const char *ffor, const char *frev, khash_t(pool_hash) *h)
+{
+	const char *key = NULL;
+	char *v = NULL;
+	int fret = 0;
+	int rret = 0;
+	int ret = 0;
+	FQREC frec;
+	FQREC rrec;
+	READER *fin = NULL;
+	READER *rin = NULL;
+	khash_t(mates) *m = NULL;
+	FILE *lf = cp->lf;
+
+	/* Print informational message to log */
+	if (frev)
+		loginfo(lf, "Parsing fastQ streams \'%s\' and \'%s\'.\n", ffor, frev);
+	else
+		loginfo(lf, "Parsing interleaved fastQ stream \'%s\'.\n", ffor);
+
+	/* Open input streams; an interleaved stream supplies both mates */
+	fin = reader_open(ffor, lf);
+	if (!fin)
+		return 1;
+	rin = fin;
+	if (frev)
+	{
+		rin = reader_open(frev, lf);
+		if (!rin)
+			return 1;
+	}
+
+	/* Initialize hash for mate pair information */
+	m = kh_init(mates);
+	if (!m)
+		return 1;
+
+	/* Mates are read in lockstep, so that a writer feeding both pipes never */
+	/* blocks on one of them; the mate information of each pair is only */
+	/* needed until its reverse entry is parsed */
+	while (1)
+	{
+		/* Each entry is parsed before the next is read, */
+		/* since reading may move the reader's buffer */
+		fret = reader_next(fin, &frec);
+		if (fret < 0)
+			break;
+		if (fret > 0)
+		{
+			ret = parse_forward(cp, &frec, h, m);
+			if (ret)
+				return 1;
+		}
+		rret = reader_next(rin, &rrec);
+		if (fret == 0 || rret <= 0)
+			break;
+		ret = parse_reverse(cp, &rrec, h, m);
+		if (ret)
+			return 1;
+		if (kh_size(m) >= MATE_WINDOW)
+		{
+			kh_foreach(m, key, v, free(v); free((void*)key););
+			kh_clear(mates, m);
+		}
+	}
+	if (fret < 0 || rret < 0)
+	{
+		logerror(lf, "%s:%d Failed to read data from fastQ streams.\n", __func__, __LINE__);
+		return 1;
+	}
+	if (fret != rret)
+	{
+		if (frev)
+			logerror(lf, "%s:%d Streams \'%s\' and \'%s\' hold different numbers of entries.\n",
+			         __func__, __LINE__, ffor, frev);
+		else
+			logerror(lf, "%s:%d Stream \'%s\' holds an unpaired last entry.\n",
+			         __func__, __LINE__, ffor);
+		return 1;
+	}
+
+	/* Flush remaining data in buffers */
+	ret = flush_pools(cp, FORWARD, h);
+	if (ret)
+		return 1;
+	ret = flush_pools(cp, REVERSE, h);
+	if (ret)
+		return 1;
+
+	/* Close input streams */
+	reader_close(fin);
+	if (rin != fin)
+		reader_close(rin);
+	free_matedb(m);
+
+	/* Print informational message to log */
+	if (frev)
+		loginfo(lf, "Successfully parsed fastQ streams \'%s\' and \'%s\'.\n", ffor, frev);
+	else
+		loginfo(lf, "Successfully parsed interleaved fastQ stream \'%s\'.\n", ffor);
+
+	return 0;
+}
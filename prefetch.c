@@ -0,0 +1,41 @@
+/* file: prefetch.c
+ * description: Asks the kernel to read upcoming input files into the page cache
+ * author: Daniel Garrigan Lummei Analytics LLC
+ * updated: November 2016
+ * email: dgarriga@lummei.net
+ * copyright: MIT license
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "ddradseq.h"
+
+void prefetch(const CMD *cp, char **files, unsigned int n)
+{
+	int fd = 0;
+	unsigned int i = 0;
+	off_t len = 0;
+	off_t budget = (off_t)cp->prefetch << 20;
+	struct stat st;
+
+	/* The budget is spent on the files in the order they will be read */
+	for (i = 0; i < n && budget > 0; i++)
+	{
+		fd = open(files[i], O_RDONLY);
+		if (fd < 0)
+			continue;
+		if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+		{
+			len = st.st_size < budget ? st.st_size : budget;
+
+			/* The reads are queued and the call returns without waiting for them */
+			if (posix_fadvise(fd, 0, len, POSIX_FADV_WILLNEED) == 0)
+				budget -= len;
+		}
+		close(fd);
+	}
+}
@@ -10,7 +10,6 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
-#include <zlib.h>
 #include "khash.h"
 #include "ddradseq.h"
 
@@ -18,16 +17,20 @@ khash_t(pool_hash) *read_csv(const CMD *cp)
 {
 	const char *csvfile = cp->csvfile;  /* Pointer to CSV database file name */
 	const char *outpath = cp->outdir;	/* Pointer to parent of output directories */
-	char buf[MAX_LINE_LENGTH];          /* File input buffer */
+	char *buf = NULL;                   /* File input line buffer */
 	char seps[] = ",";			        /* CSV entry separator character */
+	const char *ext = NULL;             /* Output file name extension */
 	char *tok = NULL;			        /* Holds parsed CSV tokens */
 	char *r = NULL;				        /* Residual pointer for strtok_r */
 	char *tmp = NULL;			        /* Temporary pointer */
 	bool trail = false;                 /* Boolean indicator of trailing slash */
 	int a = 0;					        /* Return value for database entry */
+	int o = 0;                          /* Read orientation */
 	size_t strl = 0;			        /* Generic string length holder */
 	size_t pathl = 0;			        /* Length of path string */
-	gzFile in;					        /* Input file stream */
+	size_t bufcap = 0;                  /* Capacity of the line buffer */
+	long len = 0;                       /* Length of the current line */
+	INSTREAM *in = NULL;                /* Input file stream */
 	khint_t i = 0;                      /* Generic hash iterator */
 	khint_t j = 0;                      /* Generic hash iterator */
 	khint_t k = 0;                      /* Generic hash iterator */
@@ -38,6 +41,9 @@ khash_t(pool_hash) *read_csv(const CMD *cp)
 	POOL *pl = NULL;                    /* Pointer to pool data structure */
 	FILE *lf = cp->lf;                  /* Pointer to log file stream */
 
+	/* Output files are named for their compression format */
+	ext = cp->format == ZSTD_FORMAT ? "zst" : "gz";
+
 	/* Print informational message to log */
 	loginfo(lf, "Parsing CSV database file \'%s\'.\n", csvfile);
 
@@ -47,7 +53,7 @@ khash_t(pool_hash) *read_csv(const CMD *cp)
 		trail = true;
 
 	/* Open input database text file stream */
-	in = gzopen(csvfile, "rb");
+	in = instream_open(csvfile, lf);
 	if (!in)
 	{
 		logerror(lf, "%s:%d Could not read CSV database file %s into memory.\n",
@@ -59,7 +65,7 @@ khash_t(pool_hash) *read_csv(const CMD *cp)
 	h = kh_init(pool_hash);
 
 	/* Read CSV and populate the database */
-	while (gzgets(in, buf, MAX_LINE_LENGTH) != Z_NULL)
+	while ((len = instream_getline(in, &buf, &bufcap)) > 0)
 	{
 		/* Re-initialize measure of outfile path string length */
 		pathl = strlen(outpath);
@@ -226,14 +232,19 @@ khash_t(pool_hash) *read_csv(const CMD *cp)
 				logerror(lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
 				return NULL;
 			}
-			bc->buffer = malloc(BUFLEN);
-			if (UNLIKELY(!bc->buffer))
+			for (o = FORWARD; o <= REVERSE; o++)
 			{
-				logerror(lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
-				return NULL;
+				bc->buffer[o] = malloc(BUFLEN);
+				if (UNLIKELY(!bc->buffer[o]))
+				{
+					logerror(lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
+					return NULL;
+				}
+				bc->buffer[o][0] = '\0';
+				bc->curr_bytes[o] = 0;
+				bc->fd[o] = -1;
+				bc->offset[o] = 0;
 			}
-			bc->buffer[0] = '\0';
-			bc->curr_bytes = 0;
 			kh_value(b, k) = bc;
 		}
 		else
@@ -261,19 +272,29 @@ khash_t(pool_hash) *read_csv(const CMD *cp)
 		/* Add barcode value to BARCODE data structure */
 		bc = kh_value(b, k);
 		bc->smplID = tmp;
-		pathl += 21u;
+		pathl += 19u + strlen(ext);
+		if (cp->part)
+			pathl += strlen(cp->part) + 6u;
 		tmp = malloc(pathl + 1u);
 		if (UNLIKELY(!tmp))
 		{
 			logerror(lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
 			return NULL;
 		}
-		sprintf(tmp, "%s/parse/smpl_%s.R1.fq.gz", pl->poolpath, bc->smplID);
+		if (cp->part)
+			sprintf(tmp, "%s/parse/smpl_%s.R1.part-%s.fq.%s", pl->poolpath, bc->smplID, cp->part,
+			        ext);
+		else
+			sprintf(tmp, "%s/parse/smpl_%s.R1.fq.%s", pl->poolpath, bc->smplID, ext);
 		bc->outfile = tmp;
 	}
 
+	if (len < 0)
+		return NULL;
+
 	/* Close input CSV file stream */
-	gzclose(in);
+	instream_close(in);
+	free(buf);
 
 	/* Print informational message to log */
 	loginfo(lf, "Successfully parsed CSV database file \'%s\'.\n", csvfile);
@@ -0,0 +1,218 @@
+/* file: reader.c
+ * description: Block-buffered fastQ record reader
+ * author: Daniel Garrigan Lummei Analytics LLC
+ * updated: November 2016
+ * email: dgarriga@lummei.net
+ * copyright: MIT license
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "ddradseq.h"
+
+extern int errno;
+
+/* Number of decompressed bytes requested from the input stream at once */
+#define READ_BLOCK (8 * BUFLEN)
+
+/* Function prototypes */
+static int reader_fill(READER *r);
+static int reader_map(READER *r, int fd);
+
+READER *reader_open(const char *filename, FILE *lf)
+{
+	char *errstr = NULL;
+	int fd = 0;
+	READER *r = NULL;
+
+	r = calloc(1, sizeof(READER));
+	if (UNLIKELY(!r))
+	{
+		logerror(lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
+		return NULL;
+	}
+	r->lf = lf;
+
+	/* The file is opened only once, since it may be a pipe */
+	fd = open(filename, O_RDONLY);
+	if (fd < 0)
+	{
+		errstr = strerror(errno);
+		logerror(lf, "%s:%d Unable to open file \'%s\': %s.\n", __func__, __LINE__,
+		         filename, errstr);
+		free(r);
+		return NULL;
+	}
+
+	/* Uncompressed files are read straight from a memory mapping */
+	if (reader_map(r, fd))
+	{
+		close(fd);
+		return r;
+	}
+
+	r->cap = 2 * READ_BLOCK;
+	r->buf = malloc(r->cap + 1u);
+	if (UNLIKELY(!r->buf))
+	{
+		logerror(lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
+		close(fd);
+		free(r);
+		return NULL;
+	}
+	r->in = instream_fdopen(fd, filename, lf);
+	if (!r->in)
+	{
+		free(r->buf);
+		free(r);
+		return NULL;
+	}
+	return r;
+}
+
+int reader_next(READER *r, FQREC *rec)
+{
+	char *line[5];
+	char *p = NULL;
+	char *end = NULL;
+	int i = 0;
+
+	while (1)
+	{
+		/* Find the four line ends of the next record */
+		p = r->buf + r->pos;
+		end = r->buf + r->len;
+		for (i = 0; i < 4; i++)
+		{
+			line[i] = p;
+			p = memchr(p, '\n', end - p);
+			if (!p)
+				break;
+			p++;
+		}
+		if (i == 4)
+			break;
+
+		/* The record runs past the end of the buffer */
+		if (r->eof)
+		{
+			/* Tolerate a missing newline at the end of the file */
+			if (i == 3 && line[3] < end)
+			{
+				p = end + 1;
+				break;
+			}
+
+			/* Ignore trailing blank lines */
+			for (p = r->buf + r->pos; p < end && (*p == '\n' || *p == '\r'); p++);
+			if (p == end)
+				return 0;
+			logerror(r->lf, "%s:%d Truncated fastQ record at end of file.\n", __func__, __LINE__);
+			return -1;
+		}
+		if (reader_fill(r))
+			return -1;
+	}
+	line[4] = p;
+
+	/* Hand out views of the lines without terminating them, */
+	/* since a mapped input file must not be written to */
+	if (UNLIKELY(*line[0] != '@'))
+	{
+		logerror(r->lf, "%s:%d Malformed fastQ record identifier line.\n", __func__, __LINE__);
+		return -1;
+	}
+	rec->id = line[0] + 1;
+	rec->idlen = line[1] - line[0] - 2;
+	rec->seq = line[1];
+	rec->seqlen = line[2] - line[1] - 1;
+	rec->qual = line[3];
+	rec->quallen = line[4] - line[3] - 1;
+	r->pos = p < end ? (size_t)(p - r->buf) : r->len;
+	return 1;
+}
+
+void reader_close(READER *r)
+{
+	if (r->mapped)
+		munmap(r->buf, r->len);
+	else
+	{
+		instream_close(r->in);
+		free(r->buf);
+	}
+	free(r);
+}
+
+static int reader_fill(READER *r)
+{
+	char *tmp = NULL;
+	long nr = 0;
+
+	/* Move the partial record to the front of the buffer */
+	if (r->pos > 0)
+	{
+		memmove(r->buf, r->buf + r->pos, r->len - r->pos);
+		r->len -= r->pos;
+		r->pos = 0;
+	}
+
+	/* Grow the buffer if a single record does not fit */
+	if (r->cap - r->len < READ_BLOCK)
+	{
+		tmp = realloc(r->buf, 2 * r->cap + 1u);
+		if (UNLIKELY(!tmp))
+		{
+			logerror(r->lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
+			return 1;
+		}
+		r->buf = tmp;
+		r->cap *= 2;
+	}
+
+	nr = instream_read(r->in, r->buf + r->len, r->cap - r->len);
+	if (nr < 0)
+	{
+		logerror(r->lf, "%s:%d Failed to read fastQ input data.\n", __func__, __LINE__);
+		return 1;
+	}
+	r->len += nr;
+	if (nr == 0)
+		r->eof = true;
+	return 0;
+}
+
+static int reader_map(READER *r, int fd)
+{
+	char c = 0;
+	ssize_t nr = 0;
+	void *map = NULL;
+	struct stat st;
+
+	/* Only plain fastQ text in regular files is mapped; compressed, */
+	/* empty or piped input goes through the input stream */
+	if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode))
+		return 0;
+	nr = pread(fd, &c, 1, 0);
+	if (nr < 1 || c != '@')
+		return 0;
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED)
+		return 0;
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+	/* The whole file is one buffer that never needs refilling */
+	r->buf = map;
+	r->len = st.st_size;
+	r->cap = r->len;
+	r->eof = true;
+	r->mapped = true;
+	return 1;
+}
@@ -1,5 +1,5 @@
 /* file: revcom.c
- * description: Functions to reverse complement a DNA string with full IUPAC alphabet
+ * description: Functions to encode DNA strings and their reverse complements for the aligner
  * author: Daniel Garrigan Lummei Analytics LLC
  * updated: November 2016
  * email: dgarriga@lummei.net
@@ -9,119 +9,142 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
+#include <emmintrin.h>
 #include "ddradseq.h"
 
-/* Beginning of ASCII DNA sequence alphabet */
-#define DNA_BEGIN 65
+extern const char seq_nt4_table[256];
+
+/* Codes of the bases of the complement of each character: A, C, G and T in */
+/* either case, then the other IUPAC codes and gaps (4), the codes of three */
+/* bases, which are not supported (-2), and anything else (-1) */
+static const signed char comp_nt4_table[256] = {
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  4, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1,  3, -2,  2, -2, -1, -1,  1, -2, -1, -1,  4, -1,  4,  4, -1,
+  -1, -1,  4,  4,  0,  4, -2,  4, -1,  4, -1, -1, -1, -1, -1, -1,
+  -1,  3, -2,  2, -2, -1, -1,  1, -2, -1, -1,  4, -1,  4,  4, -1,
+  -1, -1,  4,  4,  0,  4, -2,  4, -1,  4, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+};
 
 /* Function prototypes */
-static int reverse_string(char*);
-static int complement_string(char*, FILE *lf);
+static inline __m128i reverse_bytes(__m128i v);
+static inline __m128i base_codes(__m128i v, __m128i *acgtn, int comp);
+static int revcom_slow(const char *s, size_t len, char *out, FILE *lf);
 
-char *revcom(const char *s, FILE *lf)
+int revcom_nt4(const char *s, size_t len, char *out, FILE *lf)
 {
-	char *str = NULL;
-	char *pch = NULL;
-	int ret = 0;
-	size_t strl = 0;
 	size_t i = 0;
+	__m128i v;
+	__m128i ok;
 
-	/* Create local copy of DNA string */
-	str = strdup(s);
-	pch = strchr(str,'\n');
-	if (pch)
-		*pch = '\0';
-	strl = strlen(str);
-
-	/* Convert to upper-case characters */
-	for (i = 0; i < strl; i++)
+	/* Sixteen bases at a time are read from the end of the string, */
+	/* reversed and complemented into codes in one pass; a block */
+	/* holding anything but A, C, G, T or N leaves it to the table */
+	for (i = 0; i + 16u <= len; i += 16u)
 	{
-		/* Check that characters are either alphabetical or gaps */
-		if (isalpha(str[i]))
-			str[i] = toupper(str[i]);
-		else if (str[i] == '-')
-			continue;
-		else
-		{
-			logerror(lf, "%s:%d Bad character \'%c\' at position %zu.\n", __func__,
-			         __LINE__, str[i], i + 1u);
-			return NULL;
-		}
+		v = _mm_loadu_si128((const __m128i*)(s + len - 16u - i));
+		v = base_codes(reverse_bytes(v), &ok, 1);
+		if (UNLIKELY(_mm_movemask_epi8(ok) != 0xffff))
+			return revcom_slow(s, len, out, lf);
+		_mm_storeu_si128((__m128i*)(out + i), v);
 	}
-
-	/* If string is not null and longer than one character, */
-	/* then do the reverse complement */
-	if (str && strlen(str) > 1u)
+	for (; i < len; i++)
 	{
-		/* Reverse the string */
-		ret = reverse_string(str);
-		if (ret)
-			return NULL;
-
-		/* Complement string */
-		ret = complement_string(str, lf);
-		if (ret)
-			return NULL;
+		out[i] = comp_nt4_table[(unsigned char)s[len - 1u - i]];
+		if (UNLIKELY(out[i] < 0))
+			return revcom_slow(s, len, out, lf);
 	}
-	return str;
+
+	return 0;
 }
 
-static int reverse_string(char *s)
+void encode_nt4(const char *s, size_t len, char *out)
 {
-	char *p1 = s;
-	char *p2 = s + strlen(s) - 1;
+	size_t i = 0;
+	__m128i v;
+	__m128i ok;
 
-	/* Reverse string */
-	while (p2 > p1)
+	/* Anything but A, C, G and T is encoded as N, as by seq_nt4_table */
+	for (i = 0; i + 16u <= len; i += 16u)
 	{
-		*p1 ^= *p2;
-		*p2 ^= *p1;
-		*p1 ^= *p2;
-		++p1;
-		--p2;
+		v = _mm_loadu_si128((const __m128i*)(s + i));
+		v = base_codes(v, &ok, 0);
+		_mm_storeu_si128((__m128i*)(out + i), v);
 	}
-	return 0;
+	for (; i < len; i++)
+		out[i] = seq_nt4_table[(unsigned char)s[i]];
+}
+
+static inline __m128i reverse_bytes(__m128i v)
+{
+	/* Swap the bytes of each word, then reverse the words */
+	v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+	v = _mm_shufflelo_epi16(v, 0x1b);
+	v = _mm_shufflehi_epi16(v, 0x1b);
+	return _mm_shuffle_epi32(v, 0x4e);
 }
 
-static int complement_string(char *s, FILE *lf)
+static inline __m128i base_codes(__m128i v, __m128i *acgtn, int comp)
+{
+	__m128i a;
+	__m128i c;
+	__m128i g;
+	__m128i t;
+	__m128i n;
+	__m128i code;
+
+	/* Clearing bit 5 turns lower-case letters into upper-case and */
+	/* nothing else into a letter */
+	v = _mm_and_si128(v, _mm_set1_epi8((char)0xdf));
+	a = _mm_cmpeq_epi8(v, _mm_set1_epi8('A'));
+	c = _mm_cmpeq_epi8(v, _mm_set1_epi8('C'));
+	g = _mm_cmpeq_epi8(v, _mm_set1_epi8('G'));
+	t = _mm_cmpeq_epi8(v, _mm_set1_epi8('T'));
+	*acgtn = _mm_or_si128(_mm_or_si128(a, c), _mm_or_si128(g, t));
+
+	/* A complemented base is 3 minus its code, and N is 4 either way */
+	code = _mm_and_si128(comp ? a : t, _mm_set1_epi8(3));
+	code = _mm_or_si128(code, _mm_and_si128(comp ? c : g, _mm_set1_epi8(2)));
+	code = _mm_or_si128(code, _mm_and_si128(comp ? g : c, _mm_set1_epi8(1)));
+	n = _mm_andnot_si128(*acgtn, _mm_set1_epi8(4));
+	*acgtn = _mm_or_si128(*acgtn, _mm_cmpeq_epi8(v, _mm_set1_epi8('N')));
+
+	return _mm_or_si128(code, n);
+}
+
+static int revcom_slow(const char *s, size_t len, char *out, FILE *lf)
 {
 	char c = 0;
-	char *pch1 = NULL;
-	char *pch2 = NULL;
-	char *iupac = "ACGTURYSWKMN-";
-	char *iupac_extend = "BDHV";
 	size_t i = 0;
-	unsigned int lookup_table[25] = { 6u, 0u, 19u,	0u, 0u, 0u, 0u,	 0u,  0u, 0u,
-									 12u, 0u, 10u, 13u, 0u, 0u, 0u, 17u, 22u, 2u,
-									  2u, 0u, 18u,	0u, 24u};
 
-	/* Iterate through string and complement each base */
-	for (i = 0; i < strlen(s); i++)
+	/* The other IUPAC codes and gaps are encoded as N */
+	for (i = 0; i < len; i++)
 	{
-		c = s[i];
-
-		/* Check that base is IUPAC representation */
-		pch1 = strchr(iupac, c);
-		if (!pch1)
+		c = s[len - 1u - i];
+		out[i] = comp_nt4_table[(unsigned char)c];
+		if (out[i] == -2)
 		{
-			pch2 = strchr(iupac_extend, c);
-			if (pch2)
-			{
-				logerror(lf, "%s:%d IUPAC codes with three bases at a site are not "
-				         "supported.\n", __func__, __LINE__);
-			}
-			else
-			{
-				logerror(lf, "%s:%d Bad character \'%c\' at position %zu.\n",
-					     __func__, __LINE__, s[i], i + 1u);
-			}
+			logerror(lf, "%s:%d IUPAC codes with three bases at a site are not supported.\n",
+			         __func__, __LINE__);
+			return 1;
+		}
+		if (out[i] < 0)
+		{
+			logerror(lf, "%s:%d Bad character \'%c\' at position %zu.\n", __func__, __LINE__, c,
+			         len - i);
 			return 1;
 		}
-		else if (c == '-')
-			continue;
-		else
-			s[i] = (char)(lookup_table[(unsigned int)(c) - DNA_BEGIN] + DNA_BEGIN);
 	}
+
 	return 0;
 }
@@ -0,0 +1,63 @@
+/* file: sw_avx2.c
+ * description: Smith-Waterman kernels with 256-bit AVX2 vectors
+ * author: Daniel Garrigan Lummei Analytics LLC
+ * updated: November 2016
+ * email: dgarriga@lummei.net
+ * copyright: MIT license
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <immintrin.h>
+
+/* Byte shifts of AVX2 stay within each 128-bit lane, so the low */
+/* lane is first moved up to carry its top bytes across */
+#define VEC __m256i
+#define VBYTES 32
+#define V_ZERO() _mm256_setzero_si256()
+#define V_SET8(x) _mm256_set1_epi8(x)
+#define V_SET16(x) _mm256_set1_epi16(x)
+#define V_LOAD(p) _mm256_load_si256(p)
+#define V_STORE(p, v) _mm256_store_si256((p), (v))
+#define V_STOREU(p, v) _mm256_storeu_si256((__m256i*)(p), (v))
+#define V_CMPEQ8(a, b) _mm256_cmpeq_epi8((a), (b))
+#define V_AND(a, b) _mm256_and_si256((a), (b))
+#define V_OR(a, b) _mm256_or_si256((a), (b))
+#define V_ANDNOT(a, b) _mm256_andnot_si256((a), (b))
+#define V_ADDS_U8(a, b) _mm256_adds_epu8((a), (b))
+#define V_SUBS_U8(a, b) _mm256_subs_epu8((a), (b))
+#define V_MAX_U8(a, b) _mm256_max_epu8((a), (b))
+#define V_ADDS_I16(a, b) _mm256_adds_epi16((a), (b))
+#define V_SUBS_U16(a, b) _mm256_subs_epu16((a), (b))
+#define V_MAX_I16(a, b) _mm256_max_epi16((a), (b))
+#define V_SHL8(v) _mm256_alignr_epi8((v), _mm256_permute2x128_si256((v), (v), 0x08), 15)
+#define V_SHL16(v) _mm256_alignr_epi8((v), _mm256_permute2x128_si256((v), (v), 0x08), 14)
+#define V_HMAX_U8(v) hmax_u8(v)
+#define V_HMAX_I16(v) hmax_i16(v)
+#define V_NONE_ABOVE_U8(f, h) \
+	(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_subs_epu8((f), (h)), _mm256_setzero_si256())) == -1)
+#define V_NONE_ABOVE_I16(f, h) (!_mm256_movemask_epi8(_mm256_cmpgt_epi16((f), (h))))
+#define SW_NAME(x) x##_avx2
+
+static inline int hmax_u8(__m256i v)
+{
+	__m128i x = _mm_max_epu8(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+
+	x = _mm_max_epu8(x, _mm_srli_si128(x, 8));
+	x = _mm_max_epu8(x, _mm_srli_si128(x, 4));
+	x = _mm_max_epu8(x, _mm_srli_si128(x, 2));
+	x = _mm_max_epu8(x, _mm_srli_si128(x, 1));
+	return _mm_extract_epi16(x, 0) & 0x00ff;
+}
+
+static inline int hmax_i16(__m256i v)
+{
+	__m128i x = _mm_max_epi16(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+
+	x = _mm_max_epi16(x, _mm_srli_si128(x, 8));
+	x = _mm_max_epi16(x, _mm_srli_si128(x, 4));
+	x = _mm_max_epi16(x, _mm_srli_si128(x, 2));
+	return _mm_extract_epi16(x, 0);
+}
+
+#include "sw_kernel.h"
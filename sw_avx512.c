@@ -0,0 +1,64 @@
+/* file: sw_avx512.c
+ * description: Smith-Waterman kernels with 512-bit AVX-512BW vectors
+ * author: Daniel Garrigan Lummei Analytics LLC
+ * updated: November 2016
+ * email: dgarriga@lummei.net
+ * copyright: MIT license
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <immintrin.h>
+
+/* Byte shifts stay within each 128-bit lane, so the lanes are */
+/* first moved up by one to carry their top bytes across */
+#define VEC __m512i
+#define VBYTES 64
+#define V_ZERO() _mm512_setzero_si512()
+#define V_SET8(x) _mm512_set1_epi8(x)
+#define V_SET16(x) _mm512_set1_epi16(x)
+#define V_LOAD(p) _mm512_load_si512(p)
+#define V_STORE(p, v) _mm512_store_si512((p), (v))
+#define V_STOREU(p, v) _mm512_storeu_si512((p), (v))
+#define V_CMPEQ8(a, b) _mm512_movm_epi8(_mm512_cmpeq_epi8_mask((a), (b)))
+#define V_AND(a, b) _mm512_and_si512((a), (b))
+#define V_OR(a, b) _mm512_or_si512((a), (b))
+#define V_ANDNOT(a, b) _mm512_andnot_si512((a), (b))
+#define V_ADDS_U8(a, b) _mm512_adds_epu8((a), (b))
+#define V_SUBS_U8(a, b) _mm512_subs_epu8((a), (b))
+#define V_MAX_U8(a, b) _mm512_max_epu8((a), (b))
+#define V_ADDS_I16(a, b) _mm512_adds_epi16((a), (b))
+#define V_SUBS_U16(a, b) _mm512_subs_epu16((a), (b))
+#define V_MAX_I16(a, b) _mm512_max_epi16((a), (b))
+#define V_SHL8(v) _mm512_alignr_epi8((v), _mm512_maskz_shuffle_i64x2(0xfc, (v), (v), 0x90), 15)
+#define V_SHL16(v) _mm512_alignr_epi8((v), _mm512_maskz_shuffle_i64x2(0xfc, (v), (v), 0x90), 14)
+#define V_HMAX_U8(v) hmax_u8(v)
+#define V_HMAX_I16(v) hmax_i16(v)
+#define V_NONE_ABOVE_U8(f, h) (_mm512_cmpgt_epu8_mask((f), (h)) == 0)
+#define V_NONE_ABOVE_I16(f, h) (_mm512_cmpgt_epi16_mask((f), (h)) == 0)
+#define SW_NAME(x) x##_avx512
+
+static inline int hmax_u8(__m512i v)
+{
+	__m256i y = _mm256_max_epu8(_mm512_castsi512_si256(v), _mm512_extracti64x4_epi64(v, 1));
+	__m128i x = _mm_max_epu8(_mm256_castsi256_si128(y), _mm256_extracti128_si256(y, 1));
+
+	x = _mm_max_epu8(x, _mm_srli_si128(x, 8));
+	x = _mm_max_epu8(x, _mm_srli_si128(x, 4));
+	x = _mm_max_epu8(x, _mm_srli_si128(x, 2));
+	x = _mm_max_epu8(x, _mm_srli_si128(x, 1));
+	return _mm_extract_epi16(x, 0) & 0x00ff;
+}
+
+static inline int hmax_i16(__m512i v)
+{
+	__m256i y = _mm256_max_epi16(_mm512_castsi512_si256(v), _mm512_extracti64x4_epi64(v, 1));
+	__m128i x = _mm_max_epi16(_mm256_castsi256_si128(y), _mm256_extracti128_si256(y, 1));
+
+	x = _mm_max_epi16(x, _mm_srli_si128(x, 8));
+	x = _mm_max_epi16(x, _mm_srli_si128(x, 4));
+	x = _mm_max_epi16(x, _mm_srli_si128(x, 2));
+	return _mm_extract_epi16(x, 0);
+}
+
+#include "sw_kernel.h"
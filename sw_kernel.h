@@ -0,0 +1,541 @@
+/* file: sw_kernel.h
+ * description: Striped Smith-Waterman kernels, compiled once for each vector width
+ * author: Adapted from https://github.com/attractivechaos/klib/blob/master/ksw.c
+ *         by Heng Li by Daniel Garrigan Lummei Analytics LLC
+ * updated: November 2016
+ * email: dgarriga@lummei.net
+ * copyright: MIT license
+ */
+
+/* The including file defines the vector type and operations below and */
+/* SW_NAME, which appends its instruction set to the function names:
+ *
+ *   VEC, VBYTES           vector type and its size in bytes
+ *   V_ZERO()              all-zero vector
+ *   V_SET8(x), V_SET16(x) vectors of 8-bit and 16-bit elements
+ *   V_LOAD(p), V_STORE(p, v)  aligned load and store
+ *   V_STOREU(p, v)        unaligned store
+ *   V_CMPEQ8, V_AND, V_OR, V_ANDNOT   8-bit comparison and bitwise logic
+ *   V_ADDS_U8, V_SUBS_U8, V_MAX_U8    unsigned 8-bit arithmetic
+ *   V_ADDS_I16, V_SUBS_U16, V_MAX_I16 16-bit arithmetic
+ *   V_SHL8(v), V_SHL16(v) shift the whole vector up by one element
+ *   V_HMAX_U8(v), V_HMAX_I16(v)       horizontal maximum
+ *   V_NONE_ABOVE_U8(f, h) true when no 8-bit element of f exceeds h
+ *   V_NONE_ABOVE_I16(f, h) true when no 16-bit element of f exceeds h
+ */
+
+#ifndef SW_KERNEL_H
+#define SW_KERNEL_H
+
+#include <stdint.h>
+#include "ddradseq.h"
+
+/* Define alphabet size */
+#define ALPHA_SIZE 5
+
+/* Vectors are aligned to the widest width in use */
+#define VALIGN 64
+
+extern const ALIGN_RESULT g_defr;
+
+#endif
+
+ALIGN_QUERY *SW_NAME(align_init)(ALIGN_CTX *ctx, int qlen, const char *query, const char *mat,
+                                 int size)
+{
+	int slen = 0;
+	int a = 0;
+	int tmp = 0;
+	int p = 0;
+	VEC *qp = NULL;
+	ALIGN_QUERY *q = NULL;
+
+	/* Number of values per vector */
+	p = VBYTES / size;
+
+	/* Segmented length */
+	slen = (qlen + p - 1) / p;
+
+	/* The query profile goes in memory reserved for the longest query */
+	q = ctx->q;
+
+	/* Align memory */
+	qp = (VEC*)(((size_t)q + sizeof(ALIGN_QUERY) + VALIGN - 1) / VALIGN * VALIGN);
+	q->qp = qp;
+	q->H0 = qp + slen * ALPHA_SIZE;
+	q->H1 = qp + slen * (ALPHA_SIZE + 1);
+	q->E  = qp + slen * (ALPHA_SIZE + 2);
+	q->Hmax = qp + slen * (ALPHA_SIZE + 3);
+	q->slen = slen;
+	q->qlen = qlen;
+	q->size = size;
+
+	/* Compute shift */
+	tmp = ALPHA_SIZE * ALPHA_SIZE;
+
+	/* Find the minimum and maximum score */
+	for (a = 0, q->shift = 127, q->mdiff = 0; a < tmp; a++)
+	{
+		if (mat[a] < (char)q->shift)
+			q->shift = mat[a];
+		if (mat[a] > (char)q->mdiff)
+			q->mdiff = mat[a];
+	}
+	q->max = q->mdiff;
+
+	/* NB: q->shift is uint8_t */
+	q->shift = 256 - q->shift;
+
+	/* Difference between the min and max scores */
+	q->mdiff += q->shift;
+
+	/* 16-bit scores are signed and need no shift */
+	if (size == 2)
+	{
+		short *t = (short*)qp;
+		for (a = 0; a < ALPHA_SIZE; a++)
+		{
+			int i = 0;
+			int k = 0;
+			int nlen = slen * p;
+			const char *ma = mat + a * ALPHA_SIZE;
+
+			for (i = 0; i < slen; i++)
+				for (k = i; k < nlen; k += slen)
+					*t++ = k >= qlen ? 0 : ma[(unsigned char)query[k]];
+		}
+		return q;
+	}
+
+	char *t = (char*)qp;
+	for (a = 0; a < ALPHA_SIZE; a++)
+	{
+		int i = 0;
+		int k = 0;
+		int nlen = slen * p;
+		const char *ma = mat + a * ALPHA_SIZE;
+
+		for (i = 0; i < slen; i++)
+			for (k = i; k < nlen; k += slen)
+				*t++ = (k >= qlen ? 0 : ma[(unsigned char)query[k]]) + q->shift;
+	}
+	return q;
+}
+
+ALIGN_RESULT SW_NAME(smith_waterman)(ALIGN_CTX *ctx, ALIGN_QUERY *q, int tlen, const char *target,
+                                     int _gapo, int _gape, int xtra)
+{
+	int slen = 0;
+	int i = 0;
+	int n_b = 0;
+	int te = -1;
+	int gmax = 0;
+	int minsc = 0;
+	int endsc = 0;
+	const int p = VBYTES;
+	uint64_t *b = NULL;
+	VEC zero;
+	VEC gapoe;
+	VEC gape;
+	VEC shift;
+	VEC *H0;
+	VEC *H1;
+	VEC *E;
+	VEC *Hmax;
+	ALIGN_RESULT r;
+
+	/* Initialization */
+	r = g_defr;
+	minsc = xtra & KSW_XSUBO ? xtra & 0xffff : 0x10000;
+	endsc = xtra & KSW_XSTOP ? xtra & 0xffff : 0x10000;
+	n_b = 0;
+
+	/* The b array has a slot for every target position, so it never grows */
+	b = ctx->b;
+	zero = V_ZERO();
+	gapoe = V_SET8(_gapo + _gape);
+	gape = V_SET8(_gape);
+	shift = V_SET8(q->shift);
+	H0 = q->H0;
+	H1 = q->H1;
+	E = q->E;
+	Hmax = q->Hmax;
+	slen = q->slen;
+	for (i = 0; i < slen; i++)
+	{
+		V_STORE(E + i, zero);
+		V_STORE(H0 + i, zero);
+		V_STORE(Hmax + i, zero);
+	}
+
+	/* Core loop */
+	for (i = 0; i < tlen; i++)
+	{
+		int j = 0;
+		int k = 0;
+		int imax = 0;
+		VEC e;
+		VEC h;
+		VEC f = zero;
+		VEC max = zero;
+		VEC *S = (VEC*)q->qp + target[i] * slen;
+
+		/* h=H(i-1,-1); shifted up because x64 is little-endian */
+		h = V_LOAD(H0 + slen - 1);
+		h = V_SHL8(h);
+
+		for (j = 0; LIKELY(j < slen); j++)
+		{
+			/* SW cells are computed in the following order:
+			 *	 H(i,j)	  = max{H(i-1,j-1)+S(i,j), E(i,j), F(i,j)}
+			 *	 E(i+1,j) = max{H(i,j)-q, E(i,j)-r}
+			 *	 F(i,j+1) = max{H(i,j)-q, F(i,j)-r}
+			 */
+
+			/* Compute H'(i,j); note that at the beginning, h=H'(i-1,j-1) */
+			h = V_ADDS_U8(h, V_LOAD(S + j));
+
+			/* h=H'(i-1,j-1)+S(i,j) */
+			h = V_SUBS_U8(h, shift);
+
+			/* e=E'(i,j) */
+			e = V_LOAD(E + j);
+			h = V_MAX_U8(h, e);
+
+			/* h=H'(i,j) */
+			h = V_MAX_U8(h, f);
+
+			/* Set max */
+			max = V_MAX_U8(max, h);
+
+			/* Save to H'(i,j) */
+			V_STORE(H1 + j, h);
+
+			/* Now compute E'(i+1,j); h=H'(i,j)-gapo */
+			h = V_SUBS_U8(h, gapoe);
+
+			/* e=E'(i,j)-gape */
+			e = V_SUBS_U8(e, gape);
+
+			/* e=E'(i+1,j) */
+			e = V_MAX_U8(e, h);
+
+			/* Save to E'(i+1,j) */
+			V_STORE(E + j, e);
+
+			/* Now compute F'(i,j+1) */
+			f = V_SUBS_U8(f, gape);
+			f = V_MAX_U8(f, h);
+
+			/* get H'(i-1,j) and prepare for the next j; h=H'(i-1,j) */
+			h = V_LOAD(H0 + j);
+		}
+
+		/* NB: we do not need to set E(i,j) as we disallow */
+		/* adjecent insertion and then deletion */
+		/* this block mimics SWPS3; NB: H(i,j) updated in the */
+		/* lazy-F loop cannot exceed max */
+		for (k = 0; LIKELY(k < p); k++)
+		{
+			f = V_SHL8(f);
+			for (j = 0; LIKELY(j < slen); j++)
+			{
+				h = V_LOAD(H1 + j);
+
+				/* h=H'(i,j) */
+				h = V_MAX_U8(h, f);
+				V_STORE(H1 + j, h);
+				h = V_SUBS_U8(h, gapoe);
+				f = V_SUBS_U8(f, gape);
+				if (UNLIKELY(V_NONE_ABOVE_U8(f, h)))
+					goto end_loop8;
+			}
+		}
+end_loop8:
+		/* imax is the maximum number in max */
+		imax = V_HMAX_U8(max);
+
+		/* Write the b array; this condition adds branching unfornately */
+		if (imax >= minsc)
+		{
+			/* Then append */
+			if (n_b == 0 || (int)b[n_b-1] + 1 != i)
+				b[n_b++] = (uint64_t)imax << 32 | i;
+			else if ((int)(b[n_b-1] >> 32) < imax)
+			{
+				/* Modify the last */
+				b[n_b-1] = (uint64_t)imax << 32 | i;
+			}
+		}
+		if (imax > gmax)
+		{
+			gmax = imax;
+
+			/* te is the end position on the target */
+			te = i;
+
+			/* Keep the H1 vector */
+			for (j = 0; LIKELY(j < slen); j++)
+				V_STORE(Hmax + j, V_LOAD(H1 + j));
+
+			if (gmax + q->shift >= 255 || gmax >= endsc)
+				break;
+		}
+		S = H1;
+		H1 = H0;
+
+		/* Swap H0 and H1 */
+		H0 = S;
+	}
+
+	r.score = gmax + q->shift < 255 ? gmax : 255;
+	r.target_end = te;
+
+	/* Get a->query_end, the end of query match */
+	/* find the 2nd best score */
+	if (r.score != 255)
+	{
+		int max = -1;
+		int low = 0;
+		int high = 0;
+		int qe = 0;
+		int qlen = slen * p;
+		unsigned char *t = (unsigned char*)Hmax;
+
+		/* Cells are unsigned, so scores above 127 must not read as negative; */
+		/* ties go to the first query position, so every vector width agrees */
+		for (i = 0; i < qlen; i++, t++)
+		{
+			qe = i / p + i % p * slen;
+			if ((int)*t > max || ((int)*t == max && qe < r.query_end))
+			{
+				max = *t;
+				r.query_end = qe;
+			}
+		}
+		if (n_b > 0)
+		{
+			i = (r.score + q->max - 1) / q->max;
+			low = te - i;
+			high = te + i;
+			for (i = 0; i < n_b; i++)
+			{
+				int e = (int)b[i];
+				if ((e < low || e > high) && (int)(b[i] >> 32) > r.score2)
+				{
+					r.score2 = b[i] >> 32;
+					r.target_end2 = e;
+				}
+			}
+		}
+	}
+
+	return r;
+}
+
+ALIGN_RESULT SW_NAME(smith_waterman16)(ALIGN_CTX *ctx, ALIGN_QUERY *q, int tlen, const char *target,
+                                       int _gapo, int _gape, int xtra)
+{
+	int slen = 0;
+	int i = 0;
+	int n_b = 0;
+	int te = -1;
+	int gmax = 0;
+	int minsc = 0;
+	int endsc = 0;
+	const int p = VBYTES / 2;
+	uint64_t *b = NULL;
+	VEC zero;
+	VEC gapoe;
+	VEC gape;
+	VEC *H0;
+	VEC *H1;
+	VEC *E;
+	VEC *Hmax;
+	ALIGN_RESULT r;
+
+	/* Initialization; the same as the 8-bit kernel, but */
+	/* signed 16-bit cells and no score shift */
+	r = g_defr;
+	minsc = xtra & KSW_XSUBO ? xtra & 0xffff : 0x10000;
+	endsc = xtra & KSW_XSTOP ? xtra & 0xffff : 0x10000;
+	b = ctx->b;
+	zero = V_ZERO();
+	gapoe = V_SET16(_gapo + _gape);
+	gape = V_SET16(_gape);
+	H0 = q->H0;
+	H1 = q->H1;
+	E = q->E;
+	Hmax = q->Hmax;
+	slen = q->slen;
+	for (i = 0; i < slen; i++)
+	{
+		V_STORE(E + i, zero);
+		V_STORE(H0 + i, zero);
+		V_STORE(Hmax + i, zero);
+	}
+
+	/* Core loop */
+	for (i = 0; i < tlen; i++)
+	{
+		int j = 0;
+		int k = 0;
+		int imax = 0;
+		VEC e;
+		VEC h;
+		VEC f = zero;
+		VEC max = zero;
+		VEC *S = (VEC*)q->qp + target[i] * slen;
+
+		h = V_LOAD(H0 + slen - 1);
+		h = V_SHL16(h);
+		for (j = 0; LIKELY(j < slen); j++)
+		{
+			h = V_ADDS_I16(h, V_LOAD(S + j));
+			e = V_LOAD(E + j);
+			h = V_MAX_I16(h, e);
+			h = V_MAX_I16(h, f);
+			max = V_MAX_I16(max, h);
+			V_STORE(H1 + j, h);
+			h = V_SUBS_U16(h, gapoe);
+			e = V_SUBS_U16(e, gape);
+			e = V_MAX_I16(e, h);
+			V_STORE(E + j, e);
+			f = V_SUBS_U16(f, gape);
+			f = V_MAX_I16(f, h);
+			h = V_LOAD(H0 + j);
+		}
+
+		/* Lazy-F loop */
+		for (k = 0; LIKELY(k < p); k++)
+		{
+			f = V_SHL16(f);
+			for (j = 0; LIKELY(j < slen); j++)
+			{
+				h = V_LOAD(H1 + j);
+				h = V_MAX_I16(h, f);
+				V_STORE(H1 + j, h);
+				h = V_SUBS_U16(h, gapoe);
+				f = V_SUBS_U16(f, gape);
+				if (UNLIKELY(V_NONE_ABOVE_I16(f, h)))
+					goto end_loop16;
+			}
+		}
+end_loop16:
+		imax = V_HMAX_I16(max);
+		if (imax >= minsc)
+		{
+			if (n_b == 0 || (int)b[n_b-1] + 1 != i)
+				b[n_b++] = (uint64_t)imax << 32 | i;
+			else if ((int)(b[n_b-1] >> 32) < imax)
+				b[n_b-1] = (uint64_t)imax << 32 | i;
+		}
+		if (imax > gmax)
+		{
+			gmax = imax;
+			te = i;
+			for (j = 0; LIKELY(j < slen); j++)
+				V_STORE(Hmax + j, V_LOAD(H1 + j));
+			if (gmax >= endsc)
+				break;
+		}
+		S = H1;
+		H1 = H0;
+		H0 = S;
+	}
+
+	r.score = gmax;
+	r.target_end = te;
+	{
+		int max = -1;
+		int low = 0;
+		int high = 0;
+		int qe = 0;
+		int qlen = slen * p;
+		unsigned short *t = (unsigned short*)Hmax;
+
+		for (i = 0; i < qlen; i++, t++)
+		{
+			qe = i / p + i % p * slen;
+			if ((int)*t > max || ((int)*t == max && qe < r.query_end))
+			{
+				max = *t;
+				r.query_end = qe;
+			}
+		}
+		if (n_b > 0)
+		{
+			i = (r.score + q->max - 1) / q->max;
+			low = te - i;
+			high = te + i;
+			for (i = 0; i < n_b; i++)
+			{
+				int e = (int)b[i];
+				if ((e < low || e > high) && (int)(b[i] >> 32) > r.score2)
+				{
+					r.score2 = b[i] >> 32;
+					r.target_end2 = e;
+				}
+			}
+		}
+	}
+
+	return r;
+}
+
+void SW_NAME(batch_score)(const void *bq, int qlen, const void *bt, int tlen, void *work,
+                          int gapo, int gape, int sa, int sb, unsigned char *score)
+{
+	int i = 0;
+	int j = 0;
+	const VEC *Q = (const VEC*)bq;
+	const VEC *T = (const VEC*)bt;
+	VEC *H = (VEC*)work;
+	VEC *E = H + qlen;
+	VEC zero = V_ZERO();
+	VEC four = V_SET8(4);
+	VEC gapoe = V_SET8(gapo + gape);
+	VEC gapev = V_SET8(gape);
+	VEC match = V_SET8(sa);
+	VEC mismatch = V_SET8(sb);
+	VEC max = zero;
+
+	/* Each lane holds a different pair, so the cells of a lane follow */
+	/* the scalar recurrences exactly and no lazy-F pass is needed; */
+	/* unsigned saturation keeps every cell at or above zero */
+	for (j = 0; j < qlen; j++)
+	{
+		V_STORE(H + j, zero);
+		V_STORE(E + j, zero);
+	}
+	for (i = 0; i < tlen; i++)
+	{
+		VEC t = V_LOAD(T + i);
+		VEC tn = V_CMPEQ8(t, four);
+		VEC f = zero;
+		VEC diag = zero;
+		VEC h;
+		VEC e;
+		VEC eq;
+		VEC n;
+
+		for (j = 0; LIKELY(j < qlen); j++)
+		{
+			/* Ambiguous bases, and the padding of shorter sequences, score zero */
+			eq = V_CMPEQ8(V_LOAD(Q + j), t);
+			n = V_OR(tn, V_CMPEQ8(V_LOAD(Q + j), four));
+			h = V_ADDS_U8(diag, V_ANDNOT(n, V_AND(eq, match)));
+			h = V_SUBS_U8(h, V_ANDNOT(V_OR(eq, n), mismatch));
+			diag = V_LOAD(H + j);
+			e = V_LOAD(E + j);
+			h = V_MAX_U8(h, e);
+			h = V_MAX_U8(h, f);
+			V_STORE(H + j, h);
+			max = V_MAX_U8(max, h);
+			h = V_SUBS_U8(h, gapoe);
+			V_STORE(E + j, V_MAX_U8(V_SUBS_U8(e, gapev), h));
+			f = V_MAX_U8(V_SUBS_U8(f, gapev), h);
+		}
+	}
+	V_STOREU(score, max);
+}
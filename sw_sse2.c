@@ -0,0 +1,57 @@
+/* file: sw_sse2.c
+ * description: Smith-Waterman kernels with 128-bit SSE2 vectors, the baseline for x86-64
+ * author: Daniel Garrigan Lummei Analytics LLC
+ * updated: November 2016
+ * email: dgarriga@lummei.net
+ * copyright: MIT license
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <emmintrin.h>
+
+#define VEC __m128i
+#define VBYTES 16
+#define V_ZERO() _mm_setzero_si128()
+#define V_SET8(x) _mm_set1_epi8(x)
+#define V_SET16(x) _mm_set1_epi16(x)
+#define V_LOAD(p) _mm_load_si128(p)
+#define V_STORE(p, v) _mm_store_si128((p), (v))
+#define V_STOREU(p, v) _mm_storeu_si128((__m128i*)(p), (v))
+#define V_CMPEQ8(a, b) _mm_cmpeq_epi8((a), (b))
+#define V_AND(a, b) _mm_and_si128((a), (b))
+#define V_OR(a, b) _mm_or_si128((a), (b))
+#define V_ANDNOT(a, b) _mm_andnot_si128((a), (b))
+#define V_ADDS_U8(a, b) _mm_adds_epu8((a), (b))
+#define V_SUBS_U8(a, b) _mm_subs_epu8((a), (b))
+#define V_MAX_U8(a, b) _mm_max_epu8((a), (b))
+#define V_ADDS_I16(a, b) _mm_adds_epi16((a), (b))
+#define V_SUBS_U16(a, b) _mm_subs_epu16((a), (b))
+#define V_MAX_I16(a, b) _mm_max_epi16((a), (b))
+#define V_SHL8(v) _mm_slli_si128((v), 1)
+#define V_SHL16(v) _mm_slli_si128((v), 2)
+#define V_HMAX_U8(v) hmax_u8(v)
+#define V_HMAX_I16(v) hmax_i16(v)
+#define V_NONE_ABOVE_U8(f, h) \
+	(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_subs_epu8((f), (h)), _mm_setzero_si128())) == 0xffff)
+#define V_NONE_ABOVE_I16(f, h) (!_mm_movemask_epi8(_mm_cmpgt_epi16((f), (h))))
+#define SW_NAME(x) x##_sse2
+
+static inline int hmax_u8(__m128i x)
+{
+	x = _mm_max_epu8(x, _mm_srli_si128(x, 8));
+	x = _mm_max_epu8(x, _mm_srli_si128(x, 4));
+	x = _mm_max_epu8(x, _mm_srli_si128(x, 2));
+	x = _mm_max_epu8(x, _mm_srli_si128(x, 1));
+	return _mm_extract_epi16(x, 0) & 0x00ff;
+}
+
+static inline int hmax_i16(__m128i x)
+{
+	x = _mm_max_epi16(x, _mm_srli_si128(x, 8));
+	x = _mm_max_epi16(x, _mm_srli_si128(x, 4));
+	x = _mm_max_epi16(x, _mm_srli_si128(x, 2));
+	return _mm_extract_epi16(x, 0);
+}
+
+#include "sw_kernel.h"
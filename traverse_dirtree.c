@@ -41,6 +41,11 @@ static int count_pairfiles(const char *filepath, const struct stat *info,
                            const int typeflag, struct FTW *pathinfo);
 static int get_pairfiles(const char *filepath, const struct stat *info,
                          const int typeflag, struct FTW *pathinfo);
+static int count_partfiles(const char *filepath, const struct stat *info,
+                           const int typeflag, struct FTW *pathinfo);
+static int get_partfiles(const char *filepath, const struct stat *info,
+                         const int typeflag, struct FTW *pathinfo);
+static char *fastq_suffix(const char *filepath);
 static int compare(const void *a, const void *b);
 
 unsigned int traverse_dirtree(const CMD *cp, const char *caller, char ***flist)
@@ -52,7 +57,8 @@ unsigned int traverse_dirtree(const CMD *cp, const char *caller, char ***flist)
 	unsigned int nfiles = 0;
 	FILE *lf = cp->lf;
 
-	if (string_equal(caller, "pair_main") || string_equal(caller, "trimend_main"))
+	if (string_equal(caller, "pair_main") || string_equal(caller, "trimend_main") ||
+	    string_equal(caller, "merge_main"))
 		dirpath = cp->outdir;
 	else
 		dirpath = cp->parent_indir;
@@ -70,6 +76,8 @@ unsigned int traverse_dirtree(const CMD *cp, const char *caller, char ***flist)
 		r = nftw(dirpath, count_parsefiles, USE_FDS, FTW_PHYS);
 	else if (string_equal(caller, "trimend_main"))
 		r = nftw(dirpath, count_pairfiles, USE_FDS, FTW_PHYS);
+	else if (string_equal(caller, "merge_main"))
+		r = nftw(dirpath, count_partfiles, USE_FDS, FTW_PHYS);
 	else
 		r = nftw(dirpath, count_fastqfiles, USE_FDS, FTW_PHYS);
 
@@ -99,6 +107,8 @@ unsigned int traverse_dirtree(const CMD *cp, const char *caller, char ***flist)
 		r = nftw(dirpath, get_parsefiles, USE_FDS, FTW_PHYS);
 	else if (string_equal(caller, "trimend_main"))
 		r = nftw(dirpath, get_pairfiles, USE_FDS, FTW_PHYS);
+	else if (string_equal(caller, "merge_main"))
+		r = nftw(dirpath, get_partfiles, USE_FDS, FTW_PHYS);
 	else
 		r = nftw(dirpath, get_fastqfiles, USE_FDS, FTW_PHYS);
 
@@ -178,9 +188,9 @@ static int count_parsefiles(const char *filepath, const struct stat *info,
 
 	if (typeflag == FTW_F)
 	{
-		p = strstr(filepath, ".fq.gz");
+		p = fastq_suffix(filepath);
 		q = strstr(filepath, "parse");
-		if (p != NULL && q != NULL)
+		if (p != NULL && q != NULL && !strstr(filepath, ".part-"))
 			n++;
 	}
 	return 0;
@@ -195,9 +205,9 @@ static int get_parsefiles(const char *filepath, const struct stat *info,
 
 	if (typeflag == FTW_F)
 	{
-		p = strstr(filepath, ".fq.gz");
+		p = fastq_suffix(filepath);
 		q = strstr(filepath, "parse");
-		if (p != NULL && q != NULL)
+		if (p != NULL && q != NULL && !strstr(filepath, ".part-"))
 		{
 			l = strlen(filepath);
 			f[n] = malloc(l + 1u);
@@ -221,7 +231,7 @@ static int count_pairfiles(const char *filepath, const struct stat *info,
 
 	if (typeflag == FTW_F)
 	{
-		p = strstr(filepath, ".fq.gz");
+		p = fastq_suffix(filepath);
 		q = strstr(filepath, "pairs");
 		if (p != NULL && q != NULL)
 			n++;
@@ -238,7 +248,7 @@ static int get_pairfiles(const char *filepath, const struct stat *info,
 
 	if (typeflag == FTW_F)
 	{
-		p = strstr(filepath, ".fq.gz");
+		p = fastq_suffix(filepath);
 		q = strstr(filepath, "pairs");
 		if (p != NULL && q != NULL)
 		{
@@ -256,7 +266,60 @@ static int get_pairfiles(const char *filepath, const struct stat *info,
 	return 0;
 }
 
+static int count_partfiles(const char *filepath, const struct stat *info,
+                           const int typeflag, struct FTW *pathinfo)
+{
+	char *p = NULL;
+	char *q = NULL;
+
+	if (typeflag == FTW_F)
+	{
+		p = fastq_suffix(filepath);
+		q = strstr(filepath, "parse");
+		if (p != NULL && q != NULL && strstr(filepath, ".part-"))
+			n++;
+	}
+	return 0;
+}
+
+static int get_partfiles(const char *filepath, const struct stat *info,
+                         const int typeflag, struct FTW *pathinfo)
+{
+	char *p = NULL;
+	char *q = NULL;
+	size_t l = 0;
+
+	if (typeflag == FTW_F)
+	{
+		p = fastq_suffix(filepath);
+		q = strstr(filepath, "parse");
+		if (p != NULL && q != NULL && strstr(filepath, ".part-"))
+		{
+			l = strlen(filepath);
+			f[n] = malloc(l + 1u);
+			if (UNLIKELY(!f[n]))
+			{
+				error("%s:%d Memory allocation failure.\n", __func__, __LINE__);
+				return 1;
+			}
+			strcpy(f[n], filepath);
+			n++;
+		}
+	}
+	return 0;
+}
+
 static int compare(const void *a, const void *b)
 {
 	return strcmp(*(const char **) a, *(const char **) b);
 }
+
+static char *fastq_suffix(const char *filepath)
+{
+	char *p = strstr(filepath, ".fq.gz");
+
+	/* Output files are either gzip- or Zstandard-compressed */
+	if (!p)
+		p = strstr(filepath, ".fq.zst");
+	return p;
+}
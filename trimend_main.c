@@ -9,15 +9,45 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <sys/stat.h>
 #include "ddradseq.h"
 
+#define NBASES 4
+
+/* Number of read pairs handed to a thread at a time; larger samples */
+/* are spread over several threads a batch at a time */
+#define TRIM_BATCH 4096
+
+/* Function prototypes */
+static int job_cmp(const void *a, const void *b);
+static void push_task(TRIMPOOL *tp, unsigned int w, TRIMJOB *job);
+static TRIMJOB *take_task(TRIMPOOL *tp, unsigned int w);
+static void *trim_worker(void *arg);
+static int run_task(TRIMPOOL *tp, unsigned int w, TRIMJOB *job, ALIGN_CTX *ctx);
+static int read_batch(TRIMJOB *job, TRIMBATCH *b, FILE *lf);
+static int copy_rec(ARENA *a, FQREC *dst, const FQREC *src);
+static int pack_batch(TRIMBATCH *b, const WRITER *w, FILE *lf);
+static int write_batches(TRIMPOOL *tp, TRIMJOB *job, TRIMBATCH *b, unsigned int count);
+static int close_job(TRIMPOOL *tp, TRIMJOB *job);
+
 int trimend_main(const CMD *cp)
 {
 	char *pch = NULL;
 	char **filelist = NULL;
 	int ret = 0;
-	unsigned int i = 0;
+	int i = 0;
+	int j = 0;
+	int k = 0;
+	const int sa = 1;
+	const int sb = 3;
+	unsigned int t = 0;
 	unsigned int nfiles = 0;
+	size_t spn = 0;
+	struct stat st;
+	pthread_t *tid = NULL;
+	TRIMJOB *job = NULL;
+	TRIMPOOL tp;
 	FILE *lf = cp->lf;
 
 	/* Print informational message to log file */
@@ -34,67 +64,568 @@ int trimend_main(const CMD *cp)
 		return 1;
 	}
 
-	for (i = 0; i < nfiles; i += 2)
+	/* Files are taken two at a time, so a file without its mate */
+	/* would leave the last sample half filled */
+	if (nfiles % 2u)
+	{
+		logerror(lf, "%s:%d Found %u fastQ files; every forward file needs its reverse "
+		         "mate.\n", __func__, __LINE__, nfiles);
+		return 1;
+	}
+
+	job = calloc(nfiles / 2u, sizeof(TRIMJOB));
+	if (UNLIKELY(!job))
+	{
+		logerror(lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
+		return 1;
+	}
+
+	/* Each pair of files is one sample */
+	for (i = 0; i < (int)nfiles; i += 2)
 	{
-		char *ffor = NULL;
-		char *frev = NULL;
-		size_t spn = 0;
+		TRIMJOB *tj = &job[t++];
 
 		/* Construct output file names */
-		ffor = strdup(filelist[i]);
-		if (UNLIKELY(!ffor))
+		tj->fin = filelist[i];
+		tj->rin = filelist[i+1];
+		tj->ffor = strdup(filelist[i]);
+		if (UNLIKELY(!tj->ffor))
 		{
 			logerror(lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
 			return 1;
 		}
-		frev = strdup(filelist[i+1]);
-		if (UNLIKELY(!frev))
+		tj->frev = strdup(filelist[i+1]);
+		if (UNLIKELY(!tj->frev))
 		{
 			logerror(lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
 			return 1;
 		}
-		pch = strstr(ffor, "pairs");
+		pch = strstr(tj->ffor, "pairs");
 		if (!pch)
 			return 1;
 		strncpy(pch, "final", DNAME_LENGTH);
-		pch = strstr(frev, "pairs");
+		pch = strstr(tj->frev, "pairs");
 		if (!pch)
 			return 1;
 		strncpy(pch, "final", DNAME_LENGTH);
 
 		/* Double-check that files are mates */
-		spn = strcspn(ffor, ".");
-		ret = strncmp(ffor, frev, spn);
+		spn = strcspn(tj->ffor, ".");
+		ret = strncmp(tj->ffor, tj->frev, spn);
 		if (ret)
 		{
 			logerror(lf, "%s:%d Files \'%s\' and \'%s\' do not appear to be mate-"
-				     "pairs.\n", __func__, __LINE__, ffor, frev);
+				     "pairs.\n", __func__, __LINE__, tj->ffor, tj->frev);
 			return 1;
 		}
+		if (stat(tj->fin, &st) == 0)
+			tj->size = st.st_size;
+		if (stat(tj->rin, &st) == 0)
+			tj->size += st.st_size;
+		pthread_mutex_init(&tj->lock, NULL);
+		pthread_cond_init(&tj->cond, NULL);
+	}
 
-		/* Print informational update to log file */
-		loginfo(lf, "Attempting to align sequences in \'%s\' and \'%s\'.\n", ffor, frev);
+	/* The largest samples go first, so that none is left running alone at the end */
+	qsort(job, t, sizeof(TRIMJOB), job_cmp);
 
-		/* Align mated pairs and write to output file*/
-		ret = align_mates(cp, filelist[i], filelist[i+1], ffor, frev);
-		if (ret)
+	memset(&tp, 0, sizeof(TRIMPOOL));
+	tp.cp = cp;
+	tp.job = job;
+	tp.njobs = t;
+	tp.left = t;
+	tp.nworkers = cp->nthreads < 1 ? 1u : (unsigned int)cp->nthreads;
+	tp.inflight = 2u * tp.nworkers;
+	tp.wthreads = tp.nworkers > 1 ? 1 : cp->nthreads;
+
+	loginfo(lf, "Aligning with %s Smith-Waterman kernels.\n", align_kernel()->name);
+
+	/* Initialize the scoring matrix */
+	for (i = k = 0; i < NBASES; i++)
+	{
+		for (j = 0; j < NBASES; j++)
+			tp.mat[k++] = (i == j) ? sa : -sb;
+
+		/* Ambiguous base */
+		tp.mat[k++] = 0;
+	}
+	for (j = 0; j <= NBASES; j++)
+		tp.mat[k++] = 0;
+
+	/* Every sample has at most one task at a time, so no deque */
+	/* ever holds more tasks than there are samples */
+	tp.dq = calloc(tp.nworkers, sizeof(TRIMDEQUE));
+	if (UNLIKELY(!tp.dq))
+	{
+		logerror(lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
+		return 1;
+	}
+	for (i = 0; i < (int)tp.nworkers; i++)
+	{
+		tp.dq[i].task = malloc(t * sizeof(TRIMJOB*));
+		if (UNLIKELY(!tp.dq[i].task))
+		{
+			logerror(lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
 			return 1;
+		}
+	}
+
+	/* Deal the samples out to the threads; each thread starts on its */
+	/* largest sample and the smallest are the first to be stolen */
+	for (i = (int)t - 1; i >= 0; i--)
+		push_task(&tp, (unsigned int)i % tp.nworkers, &job[i]);
 
-		/* Free allocated memory */
-		free(ffor);
-		free(frev);
+	pthread_mutex_init(&tp.lock, NULL);
+	pthread_cond_init(&tp.cond, NULL);
+	if (tp.nworkers > 1)
+	{
+		loginfo(lf, "Trimming %u samples with %u threads.\n", t, tp.nworkers);
+		tid = malloc(tp.nworkers * sizeof(pthread_t));
+		if (UNLIKELY(!tid))
+		{
+			logerror(lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
+			return 1;
+		}
+		for (i = 0; i < (int)tp.nworkers; i++)
+		{
+			if (pthread_create(&tid[i], NULL, trim_worker, &tp))
+			{
+				logerror(lf, "%s:%d Failed to start trimming thread.\n", __func__, __LINE__);
+				pthread_mutex_lock(&tp.lock);
+				tp.failed = true;
+				pthread_cond_broadcast(&tp.cond);
+				pthread_mutex_unlock(&tp.lock);
+				break;
+			}
+		}
+		for (j = 0; j < i; j++)
+			pthread_join(tid[j], NULL);
+		free(tid);
 	}
+	else
+		trim_worker(&tp);
+	pthread_cond_destroy(&tp.cond);
+	pthread_mutex_destroy(&tp.lock);
+	if (tp.failed)
+		return 1;
 
 	/* Print informational message to log file */
+	if (tp.memo_pairs > 0)
+		loginfo(lf, "Alignment cache answered %lu of %lu read pairs (%.1f%%).\n", tp.memo_hits,
+		        tp.memo_pairs, 100.0 * tp.memo_hits / tp.memo_pairs);
 	if (string_equal(cp->mode, "trimend"))
 		loginfo(lf, "Done trimming 3\' end of reverse sequences in \'%s\'.\n", cp->parent_indir);
 	else
 		loginfo(lf, "Done trimming 3\' end of reverse sequences in \'%s\'.\n", cp->outdir);
 
 	/* Deallocate memory */
-	for (i = 0; i < nfiles; i++)
+	for (i = 0; i < (int)tp.nworkers; i++)
+		free(tp.dq[i].task);
+	free(tp.dq);
+	for (i = 0; i < (int)t; i++)
+	{
+		pthread_cond_destroy(&job[i].cond);
+		pthread_mutex_destroy(&job[i].lock);
+		free(job[i].ffor);
+		free(job[i].frev);
+	}
+	free(job);
+	for (i = 0; i < (int)nfiles; i++)
 		free(filelist[i]);
 	free(filelist);
 
 	return 0;
 }
+
+static int job_cmp(const void *a, const void *b)
+{
+	const TRIMJOB *ja = (const TRIMJOB*)a;
+	const TRIMJOB *jb = (const TRIMJOB*)b;
+
+	if (ja->size != jb->size)
+		return ja->size < jb->size ? 1 : -1;
+	return strcmp(ja->fin, jb->fin);
+}
+
+static void push_task(TRIMPOOL *tp, unsigned int w, TRIMJOB *job)
+{
+	TRIMDEQUE *d = &tp->dq[w];
+
+	d->task[d->bottom % tp->njobs] = job;
+	d->bottom++;
+}
+
+static TRIMJOB *take_task(TRIMPOOL *tp, unsigned int w)
+{
+	unsigned int i = 0;
+	TRIMDEQUE *d = &tp->dq[w];
+
+	/* A thread continues with the newest task of its own deque, */
+	/* which is normally the next batch of the sample it just read from */
+	if (d->bottom != d->top)
+	{
+		d->bottom--;
+		return d->task[d->bottom % tp->njobs];
+	}
+
+	/* Otherwise it steals the oldest task of another thread */
+	for (i = 1; i < tp->nworkers; i++)
+	{
+		d = &tp->dq[(w + i) % tp->nworkers];
+		if (d->bottom != d->top)
+		{
+			d->top++;
+			return d->task[(d->top - 1u) % tp->njobs];
+		}
+	}
+
+	return NULL;
+}
+
+static void *trim_worker(void *arg)
+{
+	int ret = 0;
+	unsigned int i = 0;
+	unsigned int w = 0;
+	TRIMPOOL *tp = (TRIMPOOL*)arg;
+	TRIMJOB *job = NULL;
+	ALIGN_CTX *ctx = NULL;
+
+	/* Each thread reuses its own alignment buffers for every pair */
+	ctx = align_ctx_create(tp->cp->lf);
+
+	pthread_mutex_lock(&tp->lock);
+	w = tp->nstarted++;
+	if (!ctx)
+	{
+		tp->failed = true;
+		pthread_cond_broadcast(&tp->cond);
+	}
+	while (!tp->failed && tp->left > 0)
+	{
+		job = take_task(tp, w);
+		if (!job)
+		{
+			pthread_cond_wait(&tp->cond, &tp->lock);
+			continue;
+		}
+		pthread_mutex_unlock(&tp->lock);
+
+		ret = run_task(tp, w, job, ctx);
+
+		/* A failure releases the threads waiting on any sample */
+		if (ret)
+		{
+			for (i = 0; i < tp->njobs; i++)
+			{
+				pthread_mutex_lock(&tp->job[i].lock);
+				tp->job[i].failed = true;
+				pthread_cond_broadcast(&tp->job[i].cond);
+				pthread_mutex_unlock(&tp->job[i].lock);
+			}
+		}
+
+		pthread_mutex_lock(&tp->lock);
+		if (ret)
+		{
+			tp->failed = true;
+			pthread_cond_broadcast(&tp->cond);
+		}
+	}
+	if (ctx)
+	{
+		tp->memo_hits += ctx->memo_hits;
+		tp->memo_pairs += ctx->memo_pairs;
+	}
+	pthread_mutex_unlock(&tp->lock);
+	align_ctx_destroy(ctx);
+	compress_free();
+	write_block_free();
+
+	return NULL;
+}
+
+static int run_task(TRIMPOOL *tp, unsigned int w, TRIMJOB *job, ALIGN_CTX *ctx)
+{
+	char *nextfiles[2];
+	unsigned int count = 0;
+	const CMD *cp = tp->cp;
+	TRIMBATCH *b = NULL;
+	FILE *lf = cp->lf;
+
+	/* The first task of a sample opens its files */
+	if (!job->fr)
+	{
+		loginfo(lf, "Attempting to align sequences in \'%s\' and \'%s\'.\n", job->ffor, job->frev);
+
+		/* Start reading the next sample in line while this one is processed */
+		if (job + 1 < tp->job + tp->njobs)
+		{
+			nextfiles[0] = job[1].fin;
+			nextfiles[1] = job[1].rin;
+			prefetch(cp, nextfiles, 2);
+		}
+
+		job->fr = reader_open(job->fin, lf);
+		if (!job->fr)
+			return 1;
+		job->rr = reader_open(job->rin, lf);
+		if (!job->rr)
+			return 1;
+		/* Forward sequences are never changed, so the forward file */
+		/* goes to the output without being compressed again */
+		if (link_file(job->fin, job->ffor, lf))
+			return 1;
+		job->rout = writer_open(job->frev, cp->final_level, tp->wthreads, lf);
+		if (!job->rout)
+			return 1;
+	}
+
+	/* Hold back while too many batches of the sample wait to be written */
+	pthread_mutex_lock(&job->lock);
+	while (job->nread - job->nwritten >= tp->inflight && !job->failed)
+		pthread_cond_wait(&job->cond, &job->lock);
+	b = job->spare;
+	if (b)
+		job->spare = b->next;
+	pthread_mutex_unlock(&job->lock);
+	if (!b)
+	{
+		b = calloc(1, sizeof(TRIMBATCH));
+		if (UNLIKELY(!b))
+		{
+			logerror(lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
+			return 1;
+		}
+		b->frec = malloc(TRIM_BATCH * sizeof(FQREC));
+		b->rrec = malloc(TRIM_BATCH * sizeof(FQREC));
+		b->arena = arena_create(lf);
+		b->text = malloc(BUFLEN);
+		if (UNLIKELY(!b->frec || !b->rrec || !b->arena || !b->text))
+		{
+			logerror(lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
+			return 1;
+		}
+	}
+
+	/* Read the next run of pairs */
+	if (read_batch(job, b, lf))
+		return 1;
+	pthread_mutex_lock(&job->lock);
+	b->seq = job->nread++;
+	job->eof = b->n < TRIM_BATCH;
+	pthread_mutex_unlock(&job->lock);
+
+	/* Another thread may read the next run while this one is aligned */
+	if (b->n == TRIM_BATCH)
+	{
+		pthread_mutex_lock(&tp->lock);
+		push_task(tp, w, job);
+		pthread_cond_signal(&tp->cond);
+		pthread_mutex_unlock(&tp->lock);
+	}
+
+	/* Align mated pairs */
+	if (align_mates(cp, tp->mat, ctx, b->frec, b->rrec, b->n, &count))
+		return 1;
+
+	/* Compress the output here too, leaving only the writes to be done in order */
+	if (pack_batch(b, job->rout, lf))
+		return 1;
+
+	return write_batches(tp, job, b, count);
+}
+
+static int read_batch(TRIMJOB *job, TRIMBATCH *b, FILE *lf)
+{
+	int fret = 0;
+	int rret = 0;
+	FQREC frec;
+	FQREC rrec;
+
+	/* Entries are copied out, since the readers move on to the next run */
+	b->n = 0;
+	arena_reset(b->arena);
+	while (b->n < TRIM_BATCH)
+	{
+		fret = reader_next(job->fr, &frec);
+		rret = reader_next(job->rr, &rrec);
+		if (fret < 0 || rret < 0)
+			return 1;
+		if (fret == 0 || rret == 0)
+			break;
+		if (copy_rec(b->arena, &b->frec[b->n], &frec) || copy_rec(b->arena, &b->rrec[b->n], &rrec))
+			return 1;
+		b->n++;
+	}
+	if (fret != rret)
+	{
+		logerror(lf, "%s:%d Files \'%s\' and \'%s\' hold different numbers of entries.\n",
+		         __func__, __LINE__, job->fin, job->rin);
+		return 1;
+	}
+
+	return 0;
+}
+
+static int copy_rec(ARENA *a, FQREC *dst, const FQREC *src)
+{
+	char *p = NULL;
+
+	p = arena_alloc(a, src->idlen + src->seqlen + src->quallen);
+	if (!p)
+		return 1;
+	memcpy(p, src->id, src->idlen);
+	dst->id = p;
+	dst->idlen = src->idlen;
+	p += src->idlen;
+	memcpy(p, src->seq, src->seqlen);
+	dst->seq = p;
+	dst->seqlen = src->seqlen;
+	p += src->seqlen;
+	memcpy(p, src->qual, src->quallen);
+	dst->qual = p;
+	dst->quallen = src->quallen;
+
+	return 0;
+}
+
+static int pack_batch(TRIMBATCH *b, const WRITER *w, FILE *lf)
+{
+	char *tmp = NULL;
+	long nc = 0;
+	size_t i = 0;
+	size_t len = 0;
+	size_t need = 0;
+	size_t bound = compress_bound(BUFLEN, w->format);
+	const FQREC *rec = b->rrec;
+
+	/* Entries never span blocks; a block is compressed when the next */
+	/* entry does not fit, and the last one however full it is */
+	b->outlen = 0;
+	for (i = 0; i <= b->n; i++)
+	{
+		need = i < b->n ? rec[i].idlen + rec[i].seqlen + rec[i].quallen + 6u : 0;
+		if (need >= BUFLEN)
+		{
+			logerror(lf, "%s:%d Output entry is larger than the output buffer.\n",
+			         __func__, __LINE__);
+			return 1;
+		}
+		if (len > 0 && (i == b->n || len + need >= BUFLEN))
+		{
+			if (b->outcap - b->outlen < bound)
+			{
+				tmp = realloc(b->out, b->outcap + 4u * bound);
+				if (UNLIKELY(!tmp))
+				{
+					logerror(lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
+					return 1;
+				}
+				b->out = tmp;
+				b->outcap += 4u * bound;
+			}
+			nc = writer_pack(w, b->text, len, b->out + b->outlen,
+			                 b->outcap - b->outlen);
+			if (nc < 0)
+			{
+				logerror(lf, "%s:%d Failed to compress output block.\n", __func__, __LINE__);
+				return 1;
+			}
+			b->outlen += (size_t)nc;
+			len = 0;
+		}
+		if (i == b->n)
+			break;
+		b->text[len++] = '@';
+		memcpy(b->text + len, rec[i].id, rec[i].idlen);
+		len += rec[i].idlen;
+		b->text[len++] = '\n';
+		memcpy(b->text + len, rec[i].seq, rec[i].seqlen);
+		len += rec[i].seqlen;
+		memcpy(b->text + len, "\n+\n", 3u);
+		len += 3u;
+		memcpy(b->text + len, rec[i].qual, rec[i].quallen);
+		len += rec[i].quallen;
+		b->text[len++] = '\n';
+	}
+
+	return 0;
+}
+
+static int write_batches(TRIMPOOL *tp, TRIMJOB *job, TRIMBATCH *b, unsigned int count)
+{
+	int ret = 0;
+	bool done = false;
+	TRIMBATCH **p = NULL;
+	FILE *lf = tp->cp->lf;
+
+	pthread_mutex_lock(&job->lock);
+	job->count += count;
+
+	/* Batches finish out of order and wait in a reorder list for the */
+	/* earlier ones; since each batch is compressed on its own, the */
+	/* output is the same whatever the number of threads */
+	for (p = &job->waiting; *p && (*p)->seq < b->seq; p = &(*p)->next);
+	b->next = *p;
+	*p = b;
+	while (!ret && job->waiting && job->waiting->seq == job->nwritten)
+	{
+		b = job->waiting;
+		job->waiting = b->next;
+		ret = writer_append(job->rout, b->out, b->outlen);
+		b->next = job->spare;
+		job->spare = b;
+		job->nwritten++;
+	}
+	done = job->eof && job->nwritten == job->nread;
+	pthread_cond_broadcast(&job->cond);
+	pthread_mutex_unlock(&job->lock);
+	if (ret)
+	{
+		logerror(lf, "%s:%d Problem writing to output file.\n", __func__, __LINE__);
+		return 1;
+	}
+
+	/* Whichever thread writes the last batch closes the sample */
+	return done ? close_job(tp, job) : 0;
+}
+
+static int close_job(TRIMPOOL *tp, TRIMJOB *job)
+{
+	int ret = 0;
+	TRIMBATCH *b = NULL;
+	FILE *lf = tp->cp->lf;
+
+	/* Print informational message to logfile */
+	loginfo(lf, "%u sequences trimmed in \'%s\' and \'%s\'.\n", job->count, job->ffor, job->frev);
+
+	/* Close all file streams */
+	reader_close(job->fr);
+	reader_close(job->rr);
+	ret = writer_close(job->rout);
+	while (job->spare)
+	{
+		b = job->spare;
+		job->spare = b->next;
+		arena_destroy(b->arena);
+		free(b->text);
+		free(b->out);
+		free(b->frec);
+		free(b->rrec);
+		free(b);
+	}
+	if (ret)
+	{
+		logerror(lf, "%s:%d Problem writing output files \'%s\' and \'%s\'.\n", __func__,
+		         __LINE__, job->ffor, job->frev);
+		return 1;
+	}
+
+	pthread_mutex_lock(&tp->lock);
+	tp->left--;
+	pthread_cond_broadcast(&tp->cond);
+	pthread_mutex_unlock(&tp->lock);
+
+	return 0;
+}
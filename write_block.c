@@ -0,0 +1,104 @@
+/* file: write_block.c
+ * description: Compresses a block of data and writes it at a file offset
+ * author: Daniel Garrigan Lummei Analytics LLC
+ * updated: November 2016
+ * email: dgarriga@lummei.net
+ * copyright: MIT license
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include "ddradseq.h"
+
+extern int errno;
+
+/* Scratch space for blocks that are written synchronously */
+static __thread char *scratch = NULL;
+static __thread size_t scratch_len = 0;
+
+int write_block(int fd, off_t *offset, const char *data, size_t len, int level, int format,
+                FILE *lf)
+{
+	char *out = NULL;
+	long nc = 0;
+	size_t cap = compress_bound(len, format);
+
+	/* Compress straight into a free asynchronous write buffer */
+	if (aio_enabled() && cap <= aio_buflen())
+	{
+		out = aio_buffer();
+		if (!out)
+		{
+			logerror(lf, "%s:%d No asynchronous write buffer is available.\n", __func__,
+			         __LINE__);
+			return 1;
+		}
+		nc = compress_buffer(data, len, out, cap, level, format);
+		if (nc < 0)
+		{
+			logerror(lf, "%s:%d Failed to compress output block.\n", __func__, __LINE__);
+			aio_release(out);
+			return 1;
+		}
+
+		/* A failed submission returns the buffer itself */
+		if (aio_submit(fd, out, (size_t)nc, *offset))
+			return 1;
+		*offset += nc;
+		return 0;
+	}
+
+	/* Otherwise compress into scratch space and write it now */
+	if (scratch_len < cap)
+	{
+		out = realloc(scratch, cap);
+		if (UNLIKELY(!out))
+		{
+			logerror(lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
+			return 1;
+		}
+		scratch = out;
+		scratch_len = cap;
+	}
+	nc = compress_buffer(data, len, scratch, cap, level, format);
+	if (nc < 0)
+	{
+		logerror(lf, "%s:%d Failed to compress output block.\n", __func__, __LINE__);
+		return 1;
+	}
+	return write_data(fd, offset, scratch, (size_t)nc, lf);
+}
+
+void write_block_free(void)
+{
+	free(scratch);
+	scratch = NULL;
+	scratch_len = 0;
+}
+
+int write_data(int fd, off_t *offset, const char *data, size_t len, FILE *lf)
+{
+	char *errstr = NULL;
+	ssize_t nw = 0;
+	size_t done = 0;
+
+	while (done < len)
+	{
+		nw = pwrite(fd, data + done, len - done, *offset + done);
+		if (nw < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			errstr = strerror(errno);
+			logerror(lf, "%s:%d Failed to write output block: %s.\n", __func__,
+			         __LINE__, errstr);
+			return 1;
+		}
+		done += nw;
+	}
+	*offset += len;
+	return 0;
+}
@@ -19,6 +19,9 @@ void logerror(FILE *lf, const char *format, ...)
 	/* Update time string */
 	get_timestr(&timestr[0]);
 
+	/* Hold the streams so that messages from several threads do not interleave */
+	flockfile(stderr);
+	flockfile(lf);
 	fprintf(stderr, "[ddradseq: %s] ERROR -- ", timestr);
 	fprintf(lf, "[ddradseq: %s] ERROR -- ", timestr);
 	va_start(ap, format);
@@ -26,6 +29,8 @@ void logerror(FILE *lf, const char *format, ...)
 	vfprintf(stderr, format, ap);
 	vfprintf(lf, format, copy);
 	va_end(ap);
+	funlockfile(lf);
+	funlockfile(stderr);
 }
 
 void loginfo(FILE *lf, const char *format, ...)
@@ -36,10 +41,12 @@ void loginfo(FILE *lf, const char *format, ...)
 	/* Update time string */
 	get_timestr(&timestr[0]);
 
+	flockfile(lf);
 	fprintf(lf, "[ddradseq: %s] INFO -- ", timestr);
 	va_start(ap, format);
 	vfprintf(lf, format, ap);
 	va_end(ap);
+	funlockfile(lf);
 }
 
 void logwarn(FILE *lf, const char *format, ...)
@@ -50,10 +57,12 @@ void logwarn(FILE *lf, const char *format, ...)
 	/* Update time string */
 	get_timestr(&timestr[0]);
 
+	flockfile(lf);
 	fprintf(lf, "[ddradseq: %s] WARNING -- ", timestr);
 	va_start(ap, format);
 	vfprintf(lf, format, ap);
 	va_end(ap);
+	funlockfile(lf);
 }
 
 void error(const char *format, ...)
@@ -0,0 +1,35 @@
+/* file: write_pair.c
+ * description: Writes a pair of mates to the forward and reverse output files
+ * author: Daniel Garrigan Lummei Analytics LLC
+ * updated: November 2016
+ * email: dgarriga@lummei.net
+ * copyright: MIT license
+ */
+
+#include <stdio.h>
+#include "ddradseq.h"
+
+int write_pair(WRITER *fout, WRITER *rout, const FASTQ *e, const FQREC *f, const FQREC *r,
+               FILE *lf)
+{
+	int ret = 0;
+	const char *seq = NULL;
+
+	/* The forward mate is either a held entry or a record in a reader's buffer */
+	if (e)
+	{
+		seq = e->text + e->idlen + 1;
+		ret = writer_printf(fout, "@%s\n%s\n+\n%s\n", e->text, seq, seq + e->seqlen + 1);
+	}
+	else
+		ret = writer_printf(fout, "@%.*s\n%.*s\n+\n%.*s\n", (int)f->idlen, f->id,
+		                    (int)f->seqlen, f->seq, (int)f->quallen, f->qual);
+	if (ret || writer_printf(rout, "@%.*s\n%.*s\n+\n%.*s\n", (int)r->idlen, r->id,
+	                         (int)r->seqlen, r->seq, (int)r->quallen, r->qual))
+	{
+		logerror(lf, "%s:%d Problem writing to output file.\n", __func__, __LINE__);
+		return 1;
+	}
+
+	return 0;
+}
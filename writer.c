@@ -0,0 +1,230 @@
+/* file: writer.c
+ * description: Block-buffered compressed output file streams
+ * author: Daniel Garrigan Lummei Analytics LLC
+ * updated: November 2016
+ * email: dgarriga@lummei.net
+ * copyright: MIT license
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#include "ddradseq.h"
+
+extern int errno;
+
+/* Function prototypes */
+static int writer_flush(WRITER *w, bool last);
+
+WRITER *writer_open(const char *filename, int level, int nthreads, FILE *lf)
+{
+	char *errstr = NULL;
+	size_t l = strlen(filename);
+	mode_t mode;
+	WRITER *w = NULL;
+
+	/* Set permissions if new output file needs to be created */
+	mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH;
+
+	w = calloc(1, sizeof(WRITER));
+	if (UNLIKELY(!w))
+	{
+		logerror(lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
+		return NULL;
+	}
+	w->level = level;
+	w->lf = lf;
+
+	/* The output format follows the file name extension */
+	w->format = GZIP_FORMAT;
+	if (l > 4u && string_equal(filename + l - 4u, ".zst"))
+		w->format = ZSTD_FORMAT;
+
+	if (w->format == ZSTD_FORMAT)
+	{
+#ifdef HAVE_ZSTD
+		/* Zstandard files are written as one stream, so that */
+		/* its worker threads can compress ahead of the writer */
+		w->zc = ZSTD_createCCtx();
+		w->zcap = ZSTD_CStreamOutSize();
+		w->zbuf = malloc(w->zcap);
+		if (UNLIKELY(!w->zc || !w->zbuf))
+		{
+			logerror(lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
+			goto fail;
+		}
+		ZSTD_CCtx_setParameter(w->zc, ZSTD_c_compressionLevel, level);
+		if (nthreads > 1)
+			ZSTD_CCtx_setParameter(w->zc, ZSTD_c_nbWorkers, nthreads);
+#else
+		logerror(lf, "%s:%d Cannot write \'%s\': ddradseq was compiled without "
+		         "Zstandard support.\n", __func__, __LINE__, filename);
+		goto fail;
+#endif
+	}
+
+	w->buf = malloc(BUFLEN);
+	if (UNLIKELY(!w->buf))
+	{
+		logerror(lf, "%s:%d Memory allocation failure.\n", __func__, __LINE__);
+		goto fail;
+	}
+	/* An earlier output is removed rather than truncated, as trimend */
+	/* may have linked it into the final directory */
+	if (unlink(filename) < 0 && errno != ENOENT)
+	{
+		errstr = strerror(errno);
+		logerror(lf, "%s:%d Unable to replace output file '%s': %s.\n", __func__,
+		         __LINE__, filename, errstr);
+		goto fail;
+	}
+	w->fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, mode);
+	if (w->fd < 0)
+	{
+		errstr = strerror(errno);
+		logerror(lf, "%s:%d Unable to open output file \'%s\': %s.\n", __func__,
+		         __LINE__, filename, errstr);
+		goto fail;
+	}
+	return w;
+
+fail:
+#ifdef HAVE_ZSTD
+	if (w->zc)
+		ZSTD_freeCCtx(w->zc);
+#endif
+	free(w->zbuf);
+	free(w->buf);
+	free(w);
+	return NULL;
+}
+
+int writer_printf(WRITER *w, const char *format, ...)
+{
+	int n = 0;
+	va_list ap;
+
+	/* Try to format the entry into the current block */
+	va_start(ap, format);
+	n = vsnprintf(w->buf + w->len, BUFLEN - w->len, format, ap);
+	va_end(ap);
+	if (n < 0)
+		return 1;
+	if ((size_t)n < BUFLEN - w->len)
+	{
+		w->len += n;
+		return 0;
+	}
+
+	/* The entry did not fit-- write out the block and start a new one */
+	if (writer_flush(w, false))
+		return 1;
+	va_start(ap, format);
+	n = vsnprintf(w->buf, BUFLEN, format, ap);
+	va_end(ap);
+	if (n < 0 || n >= BUFLEN)
+	{
+		logerror(w->lf, "%s:%d Output entry is larger than the output buffer.\n",
+		         __func__, __LINE__);
+		return 1;
+	}
+	w->len = n;
+	return 0;
+}
+
+long writer_pack(const WRITER *w, const char *in, size_t len, char *out, size_t cap)
+{
+	/* Each block is a self-contained gzip member or Zstandard frame */
+	return compress_buffer(in, len, out, cap, w->level, w->format);
+}
+
+int writer_append(WRITER *w, const char *data, size_t len)
+{
+	/* Entries formatted so far go ahead of the appended blocks, */
+	/* and a Zstandard stream ends its frame before them */
+	if (w->len > 0 && writer_flush(w, w->format == ZSTD_FORMAT))
+		return 1;
+	if (len == 0)
+		return 0;
+	w->packed = true;
+	return write_data(w->fd, &w->offset, data, len, w->lf);
+}
+
+int writer_close(WRITER *w)
+{
+	int ret = 0;
+
+	/* Write the last block; an empty file still gets an empty member */
+	ret = writer_flush(w, true);
+
+	/* Wait for any writes still in flight before closing the file */
+	if (aio_enabled() && aio_drain())
+		ret = 1;
+	if (close(w->fd) < 0)
+		ret = 1;
+#ifdef HAVE_ZSTD
+	if (w->zc)
+		ZSTD_freeCCtx(w->zc);
+#endif
+	free(w->zbuf);
+	free(w->buf);
+	free(w);
+	return ret;
+}
+
+static int writer_flush(WRITER *w, bool last)
+{
+#ifdef HAVE_ZSTD
+	size_t r = 0;
+	ZSTD_inBuffer in;
+	ZSTD_outBuffer out;
+#endif
+
+	/* Files written only in appended blocks need no closing member */
+	if (w->packed && w->len == 0)
+		return 0;
+
+#ifdef HAVE_ZSTD
+
+	if (w->format == ZSTD_FORMAT)
+	{
+		in.src = w->buf;
+		in.size = w->len;
+		in.pos = 0;
+		do
+		{
+			out.dst = w->zbuf;
+			out.size = w->zcap;
+			out.pos = 0;
+			r = ZSTD_compressStream2(w->zc, &out, &in, last ? ZSTD_e_end : ZSTD_e_continue);
+			if (ZSTD_isError(r))
+			{
+				logerror(w->lf, "%s:%d Failed to compress output block: %s.\n", __func__,
+				         __LINE__, ZSTD_getErrorName(r));
+				return 1;
+			}
+			if (out.pos > 0 && write_data(w->fd, &w->offset, w->zbuf, out.pos, w->lf))
+				return 1;
+		} while (last ? r != 0 : in.pos < in.size);
+		w->len = 0;
+		return 0;
+	}
+#endif
+
+	if (w->len > 0 || (last && w->offset == 0))
+	{
+		if (write_block(w->fd, &w->offset, w->buf, w->len, w->level, w->format, w->lf))
+			return 1;
+	}
+	w->len = 0;
+	return 0;
+}